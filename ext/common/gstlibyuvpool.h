@@ -0,0 +1,181 @@
+/*
+ * GStreamer
+ * Copyright (C) 2013  <<user@hostname.org>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Buffer pool setup shared by the libyuv based filters. The strides of
+ * the frames we read and write are padded so libyuv can take its aligned
+ * row paths, as far as the pools involved support it.
+ *
+ * propose_allocation completes the answer of the parent class, so it is
+ * called after chaining up. decide_allocation prepares the pool the parent
+ * class then activates, so it is called before.
+ */
+
+#ifndef __GST_LIBYUV_POOL_H__
+#define __GST_LIBYUV_POOL_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/video/gstvideopool.h>
+
+G_BEGIN_DECLS
+
+/* stride alignment mask, 64 bytes lets libyuv take its aligned row paths */
+#define GST_LIBYUV_STRIDE_ALIGN 63
+
+/* buffers a pool we configure keeps around, so the first frames do not
+ * wait for an allocation */
+#define GST_LIBYUV_MIN_BUFFERS 2
+
+/* pads the strides of a pool config to GST_LIBYUV_STRIDE_ALIGN */
+static inline void
+gst_libyuv_config_set_alignment (GstStructure * config)
+{
+  GstVideoAlignment align;
+  guint i;
+
+  gst_video_alignment_reset (&align);
+  for (i = 0; i < GST_VIDEO_MAX_PLANES; i++)
+    align.stride_align[i] = GST_LIBYUV_STRIDE_ALIGN;
+
+  gst_buffer_pool_config_add_option (config,
+      GST_BUFFER_POOL_OPTION_VIDEO_META);
+  gst_buffer_pool_config_add_option (config,
+      GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT);
+  gst_buffer_pool_config_set_video_alignment (config, &align);
+}
+
+/* configures pool for caps, with padded strides when the pool supports
+ * them and align is set. size is updated to what the pool allocates.
+ */
+static inline gboolean
+gst_libyuv_pool_configure (GstBufferPool * pool, GstCaps * caps,
+    guint * size, guint min, guint max, gboolean align)
+{
+  GstStructure *config;
+
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps, *size, min, max);
+  if (align && gst_buffer_pool_has_option (pool,
+          GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT))
+    gst_libyuv_config_set_alignment (config);
+  if (!gst_buffer_pool_set_config (pool, config))
+    return FALSE;
+
+  /* the pool grew the size for the padding */
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_get_params (config, NULL, size, NULL, NULL);
+  gst_structure_free (config);
+
+  return TRUE;
+}
+
+/* completes a query the parent class answered: offers a video pool when
+ * upstream needs one and pads the strides of the pool offered */
+static inline gboolean
+gst_libyuv_propose_allocation (GstObject * obj, GstQuery * query)
+{
+  GstBufferPool *pool = NULL;
+  GstVideoInfo info;
+  GstCaps *caps;
+  gboolean need_pool, add_pool;
+  guint size, min, max;
+
+  gst_query_parse_allocation (query, &caps, &need_pool);
+  if (caps == NULL || !gst_video_info_from_caps (&info, caps))
+    return FALSE;
+
+  if (!gst_query_find_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL))
+    gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
+
+  add_pool = gst_query_get_n_allocation_pools (query) == 0;
+  if (!add_pool) {
+    gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+  } else if (need_pool) {
+    pool = gst_video_buffer_pool_new ();
+    size = info.size;
+    min = max = 0;
+  }
+  if (pool == NULL)
+    return TRUE;
+
+  if (gst_libyuv_pool_configure (pool, caps, &size, min, max, TRUE)) {
+    if (add_pool)
+      gst_query_add_allocation_pool (query, pool, size, min, max);
+    else
+      gst_query_set_nth_allocation_pool (query, 0, pool, size, min, max);
+  } else {
+    GST_DEBUG_OBJECT (obj, "could not pad the strides of the proposed pool");
+  }
+  gst_object_unref (pool);
+
+  return TRUE;
+}
+
+/* prepares the output pool before the parent class activates it. The pool
+ * downstream offers is kept, its strides are padded if it can do that and
+ * downstream reads the video meta. Without a pool a video pool is used.
+ */
+static inline gboolean
+gst_libyuv_decide_allocation (GstObject * obj, GstQuery * query)
+{
+  GstBufferPool *pool = NULL;
+  GstVideoInfo info;
+  GstCaps *outcaps;
+  guint size, min, max;
+  gboolean update_pool, align;
+
+  gst_query_parse_allocation (query, &outcaps, NULL);
+  if (outcaps == NULL || !gst_video_info_from_caps (&info, outcaps))
+    return FALSE;
+
+  if (gst_query_get_n_allocation_pools (query) > 0) {
+    gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+    update_pool = TRUE;
+  } else {
+    size = info.size;
+    min = max = 0;
+    update_pool = FALSE;
+  }
+
+  if (pool == NULL)
+    pool = gst_video_buffer_pool_new ();
+
+  size = MAX (size, info.size);
+  if (min < GST_LIBYUV_MIN_BUFFERS)
+    min = max ? MIN (GST_LIBYUV_MIN_BUFFERS, max) : GST_LIBYUV_MIN_BUFFERS;
+
+  align = gst_query_find_allocation_meta (query, GST_VIDEO_META_API_TYPE,
+      NULL);
+  if (!gst_libyuv_pool_configure (pool, outcaps, &size, min, max, align))
+    GST_WARNING_OBJECT (obj, "pool refused our config, using its own");
+
+  if (update_pool)
+    gst_query_set_nth_allocation_pool (query, 0, pool, size, min, max);
+  else
+    gst_query_add_allocation_pool (query, pool, size, min, max);
+  gst_object_unref (pool);
+
+  return TRUE;
+}
+
+G_END_DECLS
+
+#endif /* __GST_LIBYUV_POOL_H__ */
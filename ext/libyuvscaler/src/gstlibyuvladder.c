@@ -0,0 +1,730 @@
+/*
+ * GStreamer
+ * Copyright (C) 2013  <<user@hostname.org>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:element-libyuvladder
+ *
+ * Scales one I420 input to several sizes at once, one per request src pad.
+ * The sizes are taken from the downstream caps of each pad. Every frame is
+ * produced from the next larger one, so the full resolution input is read
+ * only once per buffer instead of once per rendition as with a tee in front
+ * of several libyuvscalers.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch -v videotestsrc ! video/x-raw,width=1920,height=1080 !
+ *     libyuvladder name=l
+ *     l. ! video/x-raw,width=1280,height=720 ! fakesink
+ *     l. ! video/x-raw,width=640,height=360 ! fakesink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gst/gst.h>
+
+#include "gstlibyuvladder.h"
+#include "gstlibyuvscaler.h"
+
+#include <stdio.h>
+#include <string.h>
+
+GST_DEBUG_CATEGORY_STATIC (gst_libyuvladder_debug);
+#define GST_CAT_DEFAULT gst_libyuvladder_debug
+
+#define gst_libyuvladder_parent_class parent_class
+G_DEFINE_TYPE (Gstlibyuvladder, gst_libyuvladder, GST_TYPE_ELEMENT);
+
+static GstStaticPadTemplate gst_libyuvladder_sink_template =
+GST_STATIC_PAD_TEMPLATE (
+    "sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("I420"))
+);
+
+static GstStaticPadTemplate gst_libyuvladder_src_template =
+GST_STATIC_PAD_TEMPLATE (
+    "src_%u",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("I420"))
+);
+
+static GstPad *gst_libyuvladder_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+static void gst_libyuvladder_remove_rung (Gstlibyuvladder * ladder,
+    GstPad * pad);
+static void gst_libyuvladder_release_pad (GstElement * element, GstPad * pad);
+
+static gboolean gst_libyuvladder_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event);
+static gboolean gst_libyuvladder_sink_query (GstPad * pad, GstObject * parent,
+    GstQuery * query);
+static GstFlowReturn gst_libyuvladder_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * buf);
+
+static void
+gst_libyuvladder_class_init (GstlibyuvladderClass * klass)
+{
+  GstElementClass *gstelement_class = (GstElementClass *) klass;
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&gst_libyuvladder_sink_template));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&gst_libyuvladder_src_template));
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "I420 Ladder Scaler", "Filter/Converter/Video",
+      "Scales I420 frames to several sizes at once using libyuv",
+      "David Chen <david@remotium.com>");
+
+  gstelement_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_libyuvladder_request_new_pad);
+  gstelement_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_libyuvladder_release_pad);
+
+  GST_DEBUG_CATEGORY_INIT (gst_libyuvladder_debug, "libyuvladder", 0,
+      "Scales I420 frames to several sizes using libyuv");
+}
+
+static void
+gst_libyuvladder_init (Gstlibyuvladder * ladder)
+{
+  ladder->sinkpad =
+      gst_pad_new_from_static_template (&gst_libyuvladder_sink_template,
+      "sink");
+  gst_pad_set_chain_function (ladder->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_libyuvladder_chain));
+  gst_pad_set_event_function (ladder->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_libyuvladder_sink_event));
+  gst_pad_set_query_function (ladder->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_libyuvladder_sink_query));
+  gst_element_add_pad (GST_ELEMENT (ladder), ladder->sinkpad);
+
+  gst_video_info_init (&ladder->in_info);
+  ladder->have_info = FALSE;
+  ladder->n_rungs = 0;
+  ladder->next_pad_id = 0;
+}
+
+static GstPad *
+gst_libyuvladder_request_new_pad (GstElement * element, GstPadTemplate * templ,
+    const gchar * name, const GstCaps * caps)
+{
+  Gstlibyuvladder *ladder = GST_LIBYUVLADDER_CAST (element);
+  GstlibyuvladderRung *rung;
+  GstPad *pad;
+  gchar *padname;
+  guint id;
+
+  GST_OBJECT_LOCK (ladder);
+  if (ladder->n_rungs >= GST_LIBYUVLADDER_MAX_RUNGS)
+    goto too_many_pads;
+
+  /* generated names continue after any requested one */
+  if (name && sscanf (name, "src_%u", &id) == 1 && id >= ladder->next_pad_id)
+    ladder->next_pad_id = id + 1;
+
+  if (name)
+    padname = g_strdup (name);
+  else
+    padname = g_strdup_printf ("src_%u", ladder->next_pad_id++);
+
+  pad = gst_pad_new_from_template (templ, padname);
+  g_free (padname);
+
+  rung = &ladder->rungs[ladder->n_rungs++];
+  rung->pad = pad;
+  gst_video_info_init (&rung->info);
+  rung->configured = FALSE;
+  rung->failed = FALSE;
+  rung->pool = NULL;
+  GST_OBJECT_UNLOCK (ladder);
+
+  /* caps are pushed from the streaming thread once data flows */
+  if (GST_STATE (ladder) > GST_STATE_READY)
+    gst_pad_set_active (pad, TRUE);
+  /* the pad is dropped when it fails, only the rung is left to remove */
+  if (!gst_element_add_pad (element, pad))
+    goto add_failed;
+
+  return pad;
+
+  /* ERRORS */
+too_many_pads:
+  {
+    GST_OBJECT_UNLOCK (ladder);
+    GST_WARNING_OBJECT (ladder, "at most %d src pads",
+        GST_LIBYUVLADDER_MAX_RUNGS);
+    return NULL;
+  }
+add_failed:
+  {
+    GST_WARNING_OBJECT (ladder, "could not add a src pad");
+    gst_libyuvladder_remove_rung (ladder, pad);
+    return NULL;
+  }
+}
+
+/* drops the rung of pad and its pool */
+static void
+gst_libyuvladder_remove_rung (Gstlibyuvladder * ladder, GstPad * pad)
+{
+  GstBufferPool *pool = NULL;
+  guint i;
+
+  GST_OBJECT_LOCK (ladder);
+  for (i = 0; i < ladder->n_rungs; i++) {
+    if (ladder->rungs[i].pad == pad)
+      break;
+  }
+  if (i < ladder->n_rungs) {
+    pool = ladder->rungs[i].pool;
+    ladder->n_rungs--;
+    memmove (&ladder->rungs[i], &ladder->rungs[i + 1],
+        (ladder->n_rungs - i) * sizeof (GstlibyuvladderRung));
+  }
+  GST_OBJECT_UNLOCK (ladder);
+
+  if (pool) {
+    gst_buffer_pool_set_active (pool, FALSE);
+    gst_object_unref (pool);
+  }
+}
+
+static void
+gst_libyuvladder_release_pad (GstElement * element, GstPad * pad)
+{
+  Gstlibyuvladder *ladder = GST_LIBYUVLADDER_CAST (element);
+
+  gst_libyuvladder_remove_rung (ladder, pad);
+
+  gst_pad_set_active (pad, FALSE);
+  gst_element_remove_pad (element, pad);
+}
+
+typedef struct
+{
+  GstPad *srcpad;
+  gboolean before_caps;
+} GstlibyuvladderCopySticky;
+
+static gboolean
+gst_libyuvladder_copy_sticky (GstPad * pad, GstEvent ** event,
+    gpointer user_data)
+{
+  GstlibyuvladderCopySticky *data = user_data;
+  GstEventType type = GST_EVENT_TYPE (*event);
+
+  if (type == GST_EVENT_CAPS || type == GST_EVENT_EOS)
+    return TRUE;
+
+  /* event types are numbered in sticky order */
+  if ((type < GST_EVENT_CAPS) == data->before_caps)
+    gst_pad_push_event (data->srcpad, gst_event_ref (*event));
+
+  return TRUE;
+}
+
+/* picks the output size of a rung from what its peer accepts. Sizes left
+ * open by downstream follow the input, keeping its aspect ratio when only
+ * one of width or height is given.
+ */
+static GstCaps *
+gst_libyuvladder_fixate (Gstlibyuvladder * ladder, GstPad * pad)
+{
+  GstVideoInfo *in_info = &ladder->in_info;
+  GstCaps *tmpl, *caps;
+  GstStructure *s;
+  gint width, height;
+
+  tmpl = gst_video_info_to_caps (in_info);
+  tmpl = gst_caps_make_writable (tmpl);
+  gst_structure_set (gst_caps_get_structure (tmpl, 0),
+      "width", GST_TYPE_INT_RANGE, 1, G_MAXINT,
+      "height", GST_TYPE_INT_RANGE, 1, G_MAXINT, NULL);
+
+  caps = gst_pad_peer_query_caps (pad, tmpl);
+  gst_caps_unref (tmpl);
+
+  if (gst_caps_is_empty (caps)) {
+    gst_caps_unref (caps);
+    return NULL;
+  }
+
+  caps = gst_caps_truncate (caps);
+  caps = gst_caps_make_writable (caps);
+  s = gst_caps_get_structure (caps, 0);
+
+  if (gst_structure_get_int (s, "width", &width)) {
+    gst_structure_fixate_field_nearest_int (s, "height",
+        GST_ROUND_UP_2 (gst_util_uint64_scale_int (width, in_info->height,
+                in_info->width)));
+  } else if (gst_structure_get_int (s, "height", &height)) {
+    gst_structure_fixate_field_nearest_int (s, "width",
+        GST_ROUND_UP_2 (gst_util_uint64_scale_int (height, in_info->width,
+                in_info->height)));
+  } else {
+    gst_structure_fixate_field_nearest_int (s, "width", in_info->width);
+    gst_structure_fixate_field_nearest_int (s, "height", in_info->height);
+  }
+
+  return gst_caps_fixate (caps);
+}
+
+/* runs the allocation query of a rung. Downstream's pool is used when it
+ * takes our config, else one of our own. NULL if neither can be set up.
+ */
+static GstBufferPool *
+gst_libyuvladder_decide_pool (Gstlibyuvladder * ladder,
+    GstlibyuvladderRung * rung, GstCaps * caps)
+{
+  GstBufferPool *pool = NULL;
+  GstStructure *config;
+  GstQuery *query;
+  guint size = 0, min = 0, max = 0;
+
+  query = gst_query_new_allocation (caps, TRUE);
+  if (!gst_pad_peer_query (rung->pad, query))
+    GST_DEBUG_OBJECT (rung->pad, "allocation query failed");
+
+  if (gst_query_get_n_allocation_pools (query) > 0)
+    gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+  gst_query_unref (query);
+
+  size = MAX (size, rung->info.size);
+
+  if (pool) {
+    config = gst_buffer_pool_get_config (pool);
+    gst_buffer_pool_config_set_params (config, caps, size, min, max);
+    if (gst_buffer_pool_set_config (pool, config) &&
+        gst_buffer_pool_set_active (pool, TRUE))
+      return pool;
+
+    GST_DEBUG_OBJECT (rung->pad, "downstream pool refused our config");
+    gst_object_unref (pool);
+  }
+
+  pool = gst_video_buffer_pool_new ();
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps, size, min, max);
+  if (gst_buffer_pool_set_config (pool, config) &&
+      gst_buffer_pool_set_active (pool, TRUE))
+    return pool;
+
+  GST_WARNING_OBJECT (rung->pad, "could not set up a buffer pool");
+  gst_object_unref (pool);
+  return NULL;
+}
+
+/* negotiates one rung and sends the sticky events of the sink pad around
+ * the new caps, so pads requested mid-stream see them in order. The
+ * result is stored in the ladder and in rung, a copy owned by the caller.
+ */
+static gboolean
+gst_libyuvladder_negotiate_rung (Gstlibyuvladder * ladder,
+    GstlibyuvladderRung * rung)
+{
+  GstlibyuvladderCopySticky data;
+  GstBufferPool *pool, *old = NULL;
+  GstCaps *caps;
+  guint i;
+
+  rung->configured = FALSE;
+
+  caps = gst_libyuvladder_fixate (ladder, rung->pad);
+  if (caps == NULL || !gst_video_info_from_caps (&rung->info, caps))
+    goto no_caps;
+
+  /* downstream may hand out the same pool again, it must be inactive */
+  if (rung->pool)
+    gst_buffer_pool_set_active (rung->pool, FALSE);
+
+  GST_DEBUG_OBJECT (rung->pad, "negotiated %" GST_PTR_FORMAT, caps);
+
+  data.srcpad = rung->pad;
+  data.before_caps = TRUE;
+  gst_pad_sticky_events_foreach (ladder->sinkpad,
+      gst_libyuvladder_copy_sticky, &data);
+
+  if (!gst_pad_push_event (rung->pad, gst_event_new_caps (caps)))
+    GST_DEBUG_OBJECT (rung->pad, "caps not accepted downstream");
+
+  data.before_caps = FALSE;
+  gst_pad_sticky_events_foreach (ladder->sinkpad,
+      gst_libyuvladder_copy_sticky, &data);
+
+  pool = gst_libyuvladder_decide_pool (ladder, rung, caps);
+  gst_caps_unref (caps);
+
+  if (rung->pool)
+    gst_object_unref (rung->pool);
+  rung->pool = pool;
+  rung->configured = TRUE;
+  rung->failed = FALSE;
+
+  GST_OBJECT_LOCK (ladder);
+  for (i = 0; i < ladder->n_rungs; i++) {
+    if (ladder->rungs[i].pad == rung->pad) {
+      ladder->rungs[i].info = rung->info;
+      ladder->rungs[i].configured = TRUE;
+      ladder->rungs[i].failed = FALSE;
+      old = ladder->rungs[i].pool;
+      ladder->rungs[i].pool = pool ? gst_object_ref (pool) : NULL;
+    }
+  }
+  GST_OBJECT_UNLOCK (ladder);
+
+  if (old)
+    gst_object_unref (old);
+
+  return TRUE;
+
+  /* ERRORS */
+no_caps:
+  {
+    if (caps)
+      gst_caps_unref (caps);
+    GST_WARNING_OBJECT (rung->pad,
+        "could not negotiate, skipping until reconfigured");
+    rung->failed = TRUE;
+
+    GST_OBJECT_LOCK (ladder);
+    for (i = 0; i < ladder->n_rungs; i++) {
+      if (ladder->rungs[i].pad == rung->pad) {
+        ladder->rungs[i].configured = FALSE;
+        ladder->rungs[i].failed = TRUE;
+      }
+    }
+    GST_OBJECT_UNLOCK (ladder);
+    return FALSE;
+  }
+}
+
+/* EOS and flushes go to the configured pads. The others still get EOS so
+ * downstream can finish, after the stream-start copy_sticky would have sent
+ * them, and the flushes that take that EOS away again.
+ */
+static gboolean
+gst_libyuvladder_forward_event (Gstlibyuvladder * ladder, GstEvent * event)
+{
+  GstlibyuvladderCopySticky data;
+  GstPad *pads[GST_LIBYUVLADDER_MAX_RUNGS];
+  gboolean configured[GST_LIBYUVLADDER_MAX_RUNGS];
+  guint i, n;
+
+  GST_OBJECT_LOCK (ladder);
+  n = ladder->n_rungs;
+  for (i = 0; i < n; i++) {
+    pads[i] = gst_object_ref (ladder->rungs[i].pad);
+    configured[i] = ladder->rungs[i].configured;
+  }
+  GST_OBJECT_UNLOCK (ladder);
+
+  data.before_caps = TRUE;
+  for (i = 0; i < n; i++) {
+    if (configured[i]) {
+      gst_pad_push_event (pads[i], gst_event_ref (event));
+    } else if (GST_EVENT_TYPE (event) == GST_EVENT_EOS) {
+      data.srcpad = pads[i];
+      gst_pad_sticky_events_foreach (ladder->sinkpad,
+          gst_libyuvladder_copy_sticky, &data);
+      gst_pad_push_event (pads[i], gst_event_ref (event));
+    } else if (GST_PAD_IS_EOS (pads[i])) {
+      gst_pad_push_event (pads[i], gst_event_ref (event));
+    }
+    gst_object_unref (pads[i]);
+  }
+  gst_event_unref (event);
+
+  return TRUE;
+}
+
+static gboolean
+gst_libyuvladder_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  Gstlibyuvladder *ladder = GST_LIBYUVLADDER_CAST (parent);
+  GstPad *pads[GST_LIBYUVLADDER_MAX_RUNGS];
+  GstCaps *caps;
+  guint i, n;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:
+      gst_event_parse_caps (event, &caps);
+      if (!gst_video_info_from_caps (&ladder->in_info, caps)) {
+        gst_event_unref (event);
+        return FALSE;
+      }
+      ladder->have_info = TRUE;
+
+      /* every rung is fixated again against the new input */
+      GST_OBJECT_LOCK (ladder);
+      for (i = 0; i < ladder->n_rungs; i++) {
+        ladder->rungs[i].configured = FALSE;
+        ladder->rungs[i].failed = FALSE;
+      }
+      GST_OBJECT_UNLOCK (ladder);
+
+      gst_event_unref (event);
+      return TRUE;
+    case GST_EVENT_EOS:
+    case GST_EVENT_FLUSH_START:
+    case GST_EVENT_FLUSH_STOP:
+      return gst_libyuvladder_forward_event (ladder, event);
+    default:
+      if (!GST_EVENT_IS_STICKY (event))
+        break;
+
+      /* sticky events only go to pads that have caps, the others pick
+       * them up in order when they are negotiated */
+      n = 0;
+      GST_OBJECT_LOCK (ladder);
+      for (i = 0; i < ladder->n_rungs; i++) {
+        if (ladder->rungs[i].configured)
+          pads[n++] = gst_object_ref (ladder->rungs[i].pad);
+      }
+      GST_OBJECT_UNLOCK (ladder);
+
+      for (i = 0; i < n; i++) {
+        gst_pad_push_event (pads[i], gst_event_ref (event));
+        gst_object_unref (pads[i]);
+      }
+      gst_event_unref (event);
+      return TRUE;
+  }
+
+  return gst_pad_event_default (pad, parent, event);
+}
+
+static gboolean
+gst_libyuvladder_sink_query (GstPad * pad, GstObject * parent,
+    GstQuery * query)
+{
+  GstCaps *filter, *caps;
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_CAPS:
+      /* the rungs negotiate their own sizes, any input size will do */
+      gst_query_parse_caps (query, &filter);
+      caps = gst_pad_get_pad_template_caps (pad);
+      if (filter) {
+        GstCaps *intersection;
+
+        intersection =
+            gst_caps_intersect_full (filter, caps, GST_CAPS_INTERSECT_FIRST);
+        gst_caps_unref (caps);
+        caps = intersection;
+      }
+      gst_query_set_caps_result (query, caps);
+      gst_caps_unref (caps);
+      return TRUE;
+    default:
+      return gst_pad_query_default (pad, parent, query);
+  }
+}
+
+/* largest rung first, each one is scaled from the previous */
+static void
+gst_libyuvladder_sort_rungs (GstlibyuvladderRung * rungs, guint n)
+{
+  GstlibyuvladderRung tmp;
+  guint i, j;
+
+  for (i = 1; i < n; i++) {
+    tmp = rungs[i];
+    for (j = i; j > 0 && (guint64) rungs[j - 1].info.width *
+        rungs[j - 1].info.height < (guint64) tmp.info.width *
+        tmp.info.height; j--)
+      rungs[j] = rungs[j - 1];
+    rungs[j] = tmp;
+  }
+}
+
+static GstFlowReturn
+gst_libyuvladder_push (Gstlibyuvladder * ladder, GstPad * pad, GstBuffer * buf,
+    GstFlowReturn ret)
+{
+  GstFlowReturn flow;
+
+  flow = gst_pad_push (pad, buf);
+
+  /* a released pad is flushing, that must not stop the others */
+  if (flow == GST_FLOW_FLUSHING && GST_OBJECT_PARENT (pad) !=
+      GST_OBJECT_CAST (ladder))
+    flow = GST_FLOW_NOT_LINKED;
+
+  GST_LOG_OBJECT (pad, "pushed: %s", gst_flow_get_name (flow));
+
+  /* not-linked only if every pad is, eos only if every pad is */
+  if (flow == GST_FLOW_NOT_LINKED)
+    return ret;
+  if (flow == GST_FLOW_EOS)
+    return ret == GST_FLOW_NOT_LINKED ? GST_FLOW_EOS : ret;
+  if (flow < GST_FLOW_OK || ret == GST_FLOW_NOT_LINKED || ret == GST_FLOW_EOS)
+    return flow;
+  return ret;
+}
+
+/* an output buffer for a rung, from its pool when it has one */
+static GstBuffer *
+gst_libyuvladder_alloc (Gstlibyuvladder * ladder, GstlibyuvladderRung * rung)
+{
+  GstBuffer *buf = NULL;
+
+  if (rung->pool &&
+      gst_buffer_pool_acquire_buffer (rung->pool, &buf, NULL) == GST_FLOW_OK)
+    return buf;
+
+  /* no pool, or it was deactivated by a release or renegotiation */
+  return gst_buffer_new_allocate (NULL, rung->info.size, NULL);
+}
+
+static GstFlowReturn
+gst_libyuvladder_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
+{
+  Gstlibyuvladder *ladder = GST_LIBYUVLADDER_CAST (parent);
+  GstlibyuvladderRung rungs[GST_LIBYUVLADDER_MAX_RUNGS];
+  GstVideoFrame frames[GST_LIBYUVLADDER_MAX_RUNGS];
+  GstBuffer *outbufs[GST_LIBYUVLADDER_MAX_RUNGS];
+  GstVideoFrame in_frame, *src;
+  GstlibyuvscalerMethod filter;
+  GstFlowReturn ret = GST_FLOW_NOT_LINKED;
+  guint8 *out[3];
+  guint i, j, n, n_linked, n_active;
+
+  if (!ladder->have_info)
+    goto not_negotiated;
+
+  /* work on a copy so pads can come and go while we scale */
+  GST_OBJECT_LOCK (ladder);
+  n = ladder->n_rungs;
+  for (i = 0; i < n; i++) {
+    rungs[i] = ladder->rungs[i];
+    gst_object_ref (rungs[i].pad);
+    if (rungs[i].pool)
+      gst_object_ref (rungs[i].pool);
+  }
+  GST_OBJECT_UNLOCK (ladder);
+
+  /* unlinked rungs are neither negotiated nor scaled for, rungs that fail
+   * to negotiate are left out until downstream asks to reconfigure */
+  n_linked = n_active = 0;
+  for (i = 0; i < n; i++) {
+    if (!gst_pad_is_linked (rungs[i].pad))
+      continue;
+    n_linked++;
+    if (gst_pad_check_reconfigure (rungs[i].pad) ||
+        (!rungs[i].configured && !rungs[i].failed))
+      gst_libyuvladder_negotiate_rung (ladder, &rungs[i]);
+    if (!rungs[i].configured)
+      continue;
+
+    if (n_active != i) {
+      GstlibyuvladderRung tmp = rungs[n_active];
+
+      rungs[n_active] = rungs[i];
+      rungs[i] = tmp;
+    }
+    n_active++;
+  }
+
+  if (n_linked == 0)
+    goto done;
+  if (n_active == 0) {
+    ret = GST_FLOW_NOT_NEGOTIATED;
+    goto done;
+  }
+
+  gst_libyuvladder_sort_rungs (rungs, n_active);
+
+  if (!gst_video_frame_map (&in_frame, &ladder->in_info, buf, GST_MAP_READ))
+    goto map_failed;
+  src = &in_frame;
+
+  for (i = 0; i < n_active; i++) {
+    outbufs[i] = gst_libyuvladder_alloc (ladder, &rungs[i]);
+    gst_buffer_copy_into (outbufs[i], buf,
+        GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+    if (!gst_video_frame_map (&frames[i], &rungs[i].info, outbufs[i],
+            GST_MAP_WRITE))
+      goto out_map_failed;
+
+    for (j = 0; j < GST_VIDEO_FRAME_N_PLANES (&frames[i]); j++)
+      out[j] = GST_VIDEO_FRAME_PLANE_DATA (&frames[i], j);
+
+    filter = gst_libyuvscaler_choose_filter (GST_LIBYUVSCALER_METHOD_AUTO,
+        &src->info, &rungs[i].info);
+    gst_libyuvscaler_scale_planes (src, out,
+        GST_VIDEO_FRAME_PLANE_STRIDE (&frames[i], 0),
+        GST_VIDEO_FRAME_PLANE_STRIDE (&frames[i], 1),
+        GST_VIDEO_FRAME_WIDTH (&frames[i]),
+        GST_VIDEO_FRAME_HEIGHT (&frames[i]), filter);
+
+    /* the source of this rung is not read again, send it on */
+    gst_video_frame_unmap (src);
+    if (i > 0)
+      ret = gst_libyuvladder_push (ladder, rungs[i - 1].pad, outbufs[i - 1],
+          ret);
+    src = &frames[i];
+  }
+  gst_video_frame_unmap (src);
+  ret = gst_libyuvladder_push (ladder, rungs[n_active - 1].pad,
+      outbufs[n_active - 1], ret);
+
+done:
+  for (i = 0; i < n; i++) {
+    gst_object_unref (rungs[i].pad);
+    if (rungs[i].pool)
+      gst_object_unref (rungs[i].pool);
+  }
+  gst_buffer_unref (buf);
+
+  return ret;
+
+  /* ERRORS */
+not_negotiated:
+  {
+    GST_ERROR_OBJECT (ladder, "no input caps");
+    gst_buffer_unref (buf);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+map_failed:
+  {
+    GST_ERROR_OBJECT (ladder, "could not map input buffer");
+    ret = GST_FLOW_ERROR;
+    goto done;
+  }
+out_map_failed:
+  {
+    GST_ERROR_OBJECT (rungs[i].pad, "could not map output buffer");
+    gst_video_frame_unmap (src);
+    gst_buffer_unref (outbufs[i]);
+    if (i > 0)
+      gst_buffer_unref (outbufs[i - 1]);
+    ret = GST_FLOW_ERROR;
+    goto done;
+  }
+}
@@ -0,0 +1,79 @@
+/*
+ * GStreamer
+ * Copyright (C) 2013  <<user@hostname.org>>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_LIBYUVLADDER_H__
+#define __GST_LIBYUVLADDER_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_LIBYUVLADDER            (gst_libyuvladder_get_type())
+#define GST_LIBYUVLADDER(obj)            (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_LIBYUVLADDER,Gstlibyuvladder))
+#define GST_LIBYUVLADDER_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_LIBYUVLADDER,GstlibyuvladderClass))
+#define GST_IS_LIBYUVLADDER(obj)         (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_LIBYUVLADDER))
+#define GST_IS_LIBYUVLADDER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_LIBYUVLADDER))
+#define GST_LIBYUVLADDER_CAST(obj)       ((Gstlibyuvladder *)(obj))
+
+/* enough for a 5-rung ladder with room to spare */
+#define GST_LIBYUVLADDER_MAX_RUNGS 8
+
+typedef struct _Gstlibyuvladder      Gstlibyuvladder;
+typedef struct _GstlibyuvladderClass GstlibyuvladderClass;
+typedef struct _GstlibyuvladderRung  GstlibyuvladderRung;
+
+/*
+ * One output size, a request src pad.
+ */
+struct _GstlibyuvladderRung
+{
+  GstPad *pad;
+  GstVideoInfo info;        /* negotiated output, valid if configured */
+  gboolean configured;
+  gboolean failed;          /* negotiation failed, retried on reconfigure */
+  GstBufferPool *pool;      /* from the allocation query, or NULL */
+};
+
+struct _Gstlibyuvladder
+{
+  GstElement element;
+
+  GstPad *sinkpad;
+
+  GstVideoInfo in_info;
+  gboolean have_info;
+
+  /* protected by the object lock */
+  GstlibyuvladderRung rungs[GST_LIBYUVLADDER_MAX_RUNGS];
+  guint n_rungs;
+  guint next_pad_id;
+};
+
+struct _GstlibyuvladderClass
+{
+  GstElementClass parent_class;
+};
+
+GType gst_libyuvladder_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_LIBYUVLADDER_H__ */
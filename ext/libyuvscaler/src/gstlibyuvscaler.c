@@ -63,6 +63,8 @@
 #include <gst/gst.h>
 
 #include "gstlibyuvscaler.h"
+#include "gstlibyuvladder.h"
+#include "gstlibyuvpool.h"
 
 #include <gst/video/video.h>
 #include <gst/video/gstvideometa.h>
@@ -109,8 +111,39 @@ enum
 enum
 {
   PROP_0,
+  PROP_IN_PLACE,
+  PROP_CROP_ONLY,
+  PROP_METHOD
 };
 
+#define DEFAULT_IN_PLACE FALSE
+#define DEFAULT_CROP_ONLY FALSE
+#define DEFAULT_METHOD GST_LIBYUVSCALER_METHOD_BILINEAR
+
+#define GST_TYPE_LIBYUVSCALER_METHOD (gst_libyuvscaler_method_get_type())
+static GType
+gst_libyuvscaler_method_get_type (void)
+{
+  static GType libyuvscaler_method_type = 0;
+
+  static const GEnumValue libyuvscaler_methods[] = {
+    {GST_LIBYUVSCALER_METHOD_NONE, "Point sampling", "none"},
+    {GST_LIBYUVSCALER_METHOD_LINEAR, "Horizontal linear filter", "linear"},
+    {GST_LIBYUVSCALER_METHOD_BILINEAR, "Bilinear filter", "bilinear"},
+    {GST_LIBYUVSCALER_METHOD_BOX, "Box filter", "box"},
+    {GST_LIBYUVSCALER_METHOD_AUTO,
+        "Box for large downscales, linear near 1:1, bilinear otherwise",
+        "auto"},
+    {0, NULL, NULL},
+  };
+
+  if (!libyuvscaler_method_type) {
+    libyuvscaler_method_type =
+        g_enum_register_static ("GstlibyuvscalerMethod", libyuvscaler_methods);
+  }
+  return libyuvscaler_method_type;
+}
+
 
 static GstStaticPadTemplate gst_libyuvscaler_src_template =
 GST_STATIC_PAD_TEMPLATE (
@@ -142,6 +175,12 @@ static GstCaps * gst_libyuvscaler_transform_caps (GstBaseTransform * btrans,
 static GstCaps * gst_libyuvscaler_fixate_caps (GstBaseTransform * trans,
     GstPadDirection direction, GstCaps * caps, GstCaps * othercaps);
 
+static gboolean gst_libyuvscaler_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query);
+
+static gboolean gst_libyuvscaler_decide_allocation (GstBaseTransform * trans,
+    GstQuery * query);
+
 static gboolean gst_libyuvscaler_filter_meta (GstBaseTransform * trans, GstQuery * query,
     GType api, const GstStructure * params);
 
@@ -155,6 +194,12 @@ static gboolean gst_libyuvscaler_set_info (GstVideoFilter * filter,
 static GstFlowReturn gst_libyuvscaler_transform_frame (GstVideoFilter *filter,
   GstVideoFrame *in_frame, GstVideoFrame *out_frame);
 
+static GstFlowReturn gst_libyuvscaler_prepare_output_buffer (
+    GstBaseTransform * trans, GstBuffer * inbuf, GstBuffer ** outbuf);
+
+static GstFlowReturn gst_libyuvscaler_transform (GstBaseTransform * trans,
+    GstBuffer * inbuf, GstBuffer * outbuf);
+
 
 /* initialize the libyuvscaler's class */
 static void
@@ -168,11 +213,31 @@ gst_libyuvscaler_class_init (GstlibyuvscalerClass * klass)
   gobject_class->set_property = gst_libyuvscaler_set_property;
   gobject_class->get_property = gst_libyuvscaler_get_property;
 
+  g_object_class_install_property (gobject_class, PROP_IN_PLACE,
+      g_param_spec_boolean ("in-place", "In place",
+          "Write integer downscales into the front of the input buffer "
+          "instead of allocating an output buffer", DEFAULT_IN_PLACE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_CROP_ONLY,
+      g_param_spec_boolean ("crop-only", "Crop only",
+          "Do not scale, output the centre of the input at the output size "
+          "with a crop meta when downstream supports it", DEFAULT_CROP_ONLY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
   gst_element_class_add_pad_template (gstelement_class,
       gst_static_pad_template_get (&gst_libyuvscaler_src_template));
   gst_element_class_add_pad_template (gstelement_class,
       gst_static_pad_template_get (&gst_libyuvscaler_sink_template));
 
+  g_object_class_install_property (gobject_class, PROP_METHOD,
+      g_param_spec_enum ("method", "Method", "Scaling filter",
+          GST_TYPE_LIBYUVSCALER_METHOD, DEFAULT_METHOD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
   gst_element_class_set_static_metadata (gstelement_class, "I420 Scaler",
     "Filter/Converter/Video",
     "Scales I420 frames using libyuv",
@@ -184,12 +249,22 @@ gst_libyuvscaler_class_init (GstlibyuvscalerClass * klass)
   gstbasetransform_class->fixate_caps =
       GST_DEBUG_FUNCPTR (gst_libyuvscaler_fixate_caps);
 
+  gstbasetransform_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_libyuvscaler_propose_allocation);
+  gstbasetransform_class->decide_allocation =
+      GST_DEBUG_FUNCPTR (gst_libyuvscaler_decide_allocation);
   gstbasetransform_class->filter_meta =
       GST_DEBUG_FUNCPTR (gst_libyuvscaler_filter_meta);
 
   gstbasetransform_class->transform_meta =
       GST_DEBUG_FUNCPTR (gst_libyuvscaler_transform_meta);
 
+  gstbasetransform_class->prepare_output_buffer =
+      GST_DEBUG_FUNCPTR (gst_libyuvscaler_prepare_output_buffer);
+
+  gstbasetransform_class->transform =
+      GST_DEBUG_FUNCPTR (gst_libyuvscaler_transform);
+
   gstbasetransform_class->passthrough_on_same_caps = TRUE;
 
   gstvideofilter_class->set_info =
@@ -213,95 +288,383 @@ gst_libyuvscaler_class_init (GstlibyuvscalerClass * klass)
 static void
 gst_libyuvscaler_init (Gstlibyuvscaler * filter)
 {
+  filter->in_place = DEFAULT_IN_PLACE;
+  filter->crop_only = DEFAULT_CROP_ONLY;
+  filter->method = DEFAULT_METHOD;
+  filter->filter = DEFAULT_METHOD;
+  filter->mode = GST_LIBYUVSCALER_MODE_SCALE;
+  filter->crop_meta = FALSE;
 }
 
 static void
 gst_libyuvscaler_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec)
 {
-/*
   Gstlibyuvscaler *filter = GST_LIBYUVSCALER (object);
 
   switch (prop_id) {
-    case PROP_SILENT:
-      filter->silent = g_value_get_boolean (value);
+    case PROP_IN_PLACE:
+      GST_OBJECT_LOCK (filter);
+      filter->in_place = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (filter);
+      break;
+    case PROP_CROP_ONLY:
+      GST_OBJECT_LOCK (filter);
+      filter->crop_only = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (filter);
+      break;
+    case PROP_METHOD:
+      GST_OBJECT_LOCK (filter);
+      filter->method = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK (filter);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
-*/
 }
 
 static void
 gst_libyuvscaler_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec)
 {
-/*
   Gstlibyuvscaler *filter = GST_LIBYUVSCALER (object);
 
   switch (prop_id) {
-    case PROP_SILENT:
-      g_value_set_boolean (value, filter->silent);
+    case PROP_IN_PLACE:
+      GST_OBJECT_LOCK (filter);
+      g_value_set_boolean (value, filter->in_place);
+      GST_OBJECT_UNLOCK (filter);
+      break;
+    case PROP_CROP_ONLY:
+      GST_OBJECT_LOCK (filter);
+      g_value_set_boolean (value, filter->crop_only);
+      GST_OBJECT_UNLOCK (filter);
+      break;
+    case PROP_METHOD:
+      GST_OBJECT_LOCK (filter);
+      g_value_set_enum (value, filter->method);
+      GST_OBJECT_UNLOCK (filter);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
-*/
 }
 
 /* GstElement vmethod implementations */
 
-/* this function does the actual processing
- */
-static GstFlowReturn
-gst_libyuvscaler_transform_frame (GstVideoFilter *filter, GstVideoFrame *in_frame, GstVideoFrame *out_frame)
+/* scales the I420 planes of in_frame into the given output planes */
+void
+gst_libyuvscaler_scale_planes (GstVideoFrame * in_frame, guint8 * out[3],
+    gint out_stride, gint out_uv_stride, gint out_width, gint out_height,
+    GstlibyuvscalerMethod filter)
 {
-  Gstlibyuvscaler *scaler = GST_LIBYUVSCALER_CAST (filter);
-  gint in_width, in_height, in_stride, in_uv_stride;
-  gint out_width, out_height, out_stride, out_uv_stride;
+  gint in_stride, in_uv_stride;
   guint8 *in[3];
-  guint8 *out[3];
   gint i;
 
-  in_width = GST_VIDEO_FRAME_WIDTH (in_frame);
-  in_height = GST_VIDEO_FRAME_HEIGHT (in_frame);
   in_stride = GST_VIDEO_FRAME_PLANE_STRIDE (in_frame, 0);
   in_uv_stride = GST_VIDEO_FRAME_PLANE_STRIDE (in_frame, 1);
 
-  out_width = GST_VIDEO_FRAME_WIDTH (out_frame);
-  out_height = GST_VIDEO_FRAME_HEIGHT (out_frame);
-  out_stride = GST_VIDEO_FRAME_PLANE_STRIDE (out_frame, 0);
-  out_uv_stride = GST_VIDEO_FRAME_PLANE_STRIDE (out_frame, 1);
-
-  for (i = 0; i < GST_VIDEO_FRAME_N_PLANES (in_frame); i++) {
+  for (i = 0; i < GST_VIDEO_FRAME_N_PLANES (in_frame); i++)
     in[i] = GST_VIDEO_FRAME_PLANE_DATA (in_frame, i);
-    out[i] = GST_VIDEO_FRAME_PLANE_DATA (out_frame, i);
-  }
 
-  GST_INFO ("input: width %d height %d", in_width, in_height);
-  GST_INFO ("output: width %d height %d", out_width, out_height);
+  GST_LOG ("input: width %d height %d", GST_VIDEO_FRAME_WIDTH (in_frame),
+      GST_VIDEO_FRAME_HEIGHT (in_frame));
+  GST_LOG ("output: width %d height %d", out_width, out_height);
 
   I420Scale(in[0], in_stride,
             in[1], in_uv_stride,
             in[2], in_uv_stride,
-            in_width, in_height,
+            GST_VIDEO_FRAME_WIDTH (in_frame), GST_VIDEO_FRAME_HEIGHT (in_frame),
             out[0], out_stride,
             out[1], out_uv_stride,
             out[2], out_uv_stride,
             out_width, out_height,
-            2);
+            (enum FilterMode) filter);
+}
+
+/* top left corner of the centre window cut in crop mode, kept even for
+ * the subsampled chroma planes */
+static void
+gst_libyuvscaler_crop_window (Gstlibyuvscaler * scaler, gint * x, gint * y)
+{
+  GstVideoFilter *filter = GST_VIDEO_FILTER_CAST (scaler);
+
+  *x = GST_ROUND_DOWN_2 ((GST_VIDEO_INFO_WIDTH (&filter->in_info) -
+          GST_VIDEO_INFO_WIDTH (&filter->out_info)) / 2);
+  *y = GST_ROUND_DOWN_2 ((GST_VIDEO_INFO_HEIGHT (&filter->in_info) -
+          GST_VIDEO_INFO_HEIGHT (&filter->out_info)) / 2);
+}
+
+/* copies the centre window of in_frame to out_frame, for downstream
+ * elements that do not take a crop meta */
+static void
+gst_libyuvscaler_crop_frame (Gstlibyuvscaler * scaler,
+    GstVideoFrame * in_frame, GstVideoFrame * out_frame)
+{
+  const GstVideoFormatInfo *finfo = in_frame->info.finfo;
+  gint x, y, i, row, rows, row_size;
+  gint in_stride, out_stride;
+  guint8 *src, *dst;
+
+  gst_libyuvscaler_crop_window (scaler, &x, &y);
+
+  for (i = 0; i < GST_VIDEO_FRAME_N_PLANES (out_frame); i++) {
+    in_stride = GST_VIDEO_FRAME_PLANE_STRIDE (in_frame, i);
+    out_stride = GST_VIDEO_FRAME_PLANE_STRIDE (out_frame, i);
+    rows = GST_VIDEO_FRAME_COMP_HEIGHT (out_frame, i);
+    row_size = GST_VIDEO_FRAME_COMP_WIDTH (out_frame, i);
+
+    src = (guint8 *) GST_VIDEO_FRAME_PLANE_DATA (in_frame, i) +
+        GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT (finfo, i, y) * in_stride +
+        GST_VIDEO_FORMAT_INFO_SCALE_WIDTH (finfo, i, x);
+    dst = GST_VIDEO_FRAME_PLANE_DATA (out_frame, i);
+
+    for (row = 0; row < rows; row++) {
+      memcpy (dst, src, row_size);
+      src += in_stride;
+      dst += out_stride;
+    }
+  }
+}
+
+/* this function does the actual processing
+ */
+static GstFlowReturn
+gst_libyuvscaler_transform_frame (GstVideoFilter *filter, GstVideoFrame *in_frame, GstVideoFrame *out_frame)
+{
+  Gstlibyuvscaler *scaler = GST_LIBYUVSCALER_CAST (filter);
+  guint8 *out[3];
+  gint i;
+
+  if (scaler->mode == GST_LIBYUVSCALER_MODE_CROP) {
+    gst_libyuvscaler_crop_frame (scaler, in_frame, out_frame);
+    return GST_FLOW_OK;
+  }
+
+  for (i = 0; i < GST_VIDEO_FRAME_N_PLANES (out_frame); i++)
+    out[i] = GST_VIDEO_FRAME_PLANE_DATA (out_frame, i);
+
+  gst_libyuvscaler_scale_planes (in_frame, out,
+      GST_VIDEO_FRAME_PLANE_STRIDE (out_frame, 0),
+      GST_VIDEO_FRAME_PLANE_STRIDE (out_frame, 1),
+      GST_VIDEO_FRAME_WIDTH (out_frame), GST_VIDEO_FRAME_HEIGHT (out_frame),
+      scaler->filter);
+
+  return GST_FLOW_OK;
+}
+
+/* integer downscale into the memory of the input buffer. The output planes
+ * are laid out from the start of the memory like a freshly allocated
+ * buffer of the output size. Every output row lies at or before the input
+ * rows it is computed from, and the planes are done in order Y, U, V, so
+ * nothing is overwritten before libyuv has read it.
+ */
+static GstFlowReturn
+gst_libyuvscaler_scale_in_place (Gstlibyuvscaler * scaler, GstBuffer * buf)
+{
+  GstVideoFilter *filter = GST_VIDEO_FILTER_CAST (scaler);
+  GstVideoInfo *out_info = &filter->out_info;
+  GstVideoFrame frame;
+  GstVideoMeta *meta;
+  guint8 *base;
+  guint8 *out[3];
+  gint i;
+
+  /* the output is written from the start of the first memory, merge
+   * scattered buffers first, mapping them writable does that */
+  if (gst_buffer_n_memory (buf) > 1) {
+    GstMapInfo map;
+
+    GST_CAT_DEBUG_OBJECT (GST_CAT_PERFORMANCE, scaler,
+        "merging %u memories for in place scaling", gst_buffer_n_memory (buf));
+    if (gst_buffer_map (buf, &map, GST_MAP_READWRITE))
+      gst_buffer_unmap (buf, &map);
+  }
+
+  if (!gst_video_frame_map (&frame, &filter->in_info, buf, GST_MAP_READWRITE))
+    goto map_failed;
+
+  base = frame.map[0].data;
+  g_assert (frame.map[0].size >= GST_VIDEO_INFO_SIZE (out_info));
+
+  for (i = 0; i < GST_VIDEO_INFO_N_PLANES (out_info); i++)
+    out[i] = base + GST_VIDEO_INFO_PLANE_OFFSET (out_info, i);
+
+  gst_libyuvscaler_scale_planes (&frame, out,
+      GST_VIDEO_INFO_PLANE_STRIDE (out_info, 0),
+      GST_VIDEO_INFO_PLANE_STRIDE (out_info, 1),
+      GST_VIDEO_INFO_WIDTH (out_info), GST_VIDEO_INFO_HEIGHT (out_info),
+      scaler->filter);
+
+  gst_video_frame_unmap (&frame);
+
+  /* the buffer now holds the output frame at its start */
+  gst_buffer_set_size (buf, GST_VIDEO_INFO_SIZE (out_info));
+
+  meta = gst_buffer_get_video_meta (buf);
+  if (meta) {
+    meta->width = GST_VIDEO_INFO_WIDTH (out_info);
+    meta->height = GST_VIDEO_INFO_HEIGHT (out_info);
+    for (i = 0; i < GST_VIDEO_INFO_N_PLANES (out_info); i++) {
+      meta->offset[i] = GST_VIDEO_INFO_PLANE_OFFSET (out_info, i);
+      meta->stride[i] = GST_VIDEO_INFO_PLANE_STRIDE (out_info, i);
+    }
+  }
+
+  return GST_FLOW_OK;
+
+  /* ERRORS */
+map_failed:
+  {
+    GST_ELEMENT_ERROR (scaler, STREAM, FAILED, (NULL),
+        ("failed to map buffer for in place scaling"));
+    return GST_FLOW_ERROR;
+  }
+}
+
+/* marks the centre window on buf, which still holds the whole input frame */
+static GstFlowReturn
+gst_libyuvscaler_add_crop_meta (Gstlibyuvscaler * scaler, GstBuffer * buf)
+{
+  GstVideoFilter *filter = GST_VIDEO_FILTER_CAST (scaler);
+  GstVideoInfo *in_info = &filter->in_info;
+  GstVideoCropMeta *crop;
+  gint x, y;
+
+  gst_libyuvscaler_crop_window (scaler, &x, &y);
+
+  /* the crop is relative to the frame the video meta describes */
+  if (gst_buffer_get_video_meta (buf) == NULL)
+    gst_buffer_add_video_meta_full (buf, GST_VIDEO_FRAME_FLAG_NONE,
+        GST_VIDEO_INFO_FORMAT (in_info), GST_VIDEO_INFO_WIDTH (in_info),
+        GST_VIDEO_INFO_HEIGHT (in_info), GST_VIDEO_INFO_N_PLANES (in_info),
+        in_info->offset, in_info->stride);
+
+  /* upstream cropped already, our window is inside its one */
+  crop = gst_buffer_get_video_crop_meta (buf);
+  if (crop) {
+    x += crop->x;
+    y += crop->y;
+  } else {
+    crop = gst_buffer_add_video_crop_meta (buf);
+  }
+
+  crop->x = x;
+  crop->y = y;
+  crop->width = GST_VIDEO_INFO_WIDTH (&filter->out_info);
+  crop->height = GST_VIDEO_INFO_HEIGHT (&filter->out_info);
 
   return GST_FLOW_OK;
 }
 
+/* the input can take the output in place when it is ours alone and its
+ * video meta, which gets rewritten, does not go back to an upstream pool */
+static gboolean
+gst_libyuvscaler_can_reuse_input (GstBuffer * inbuf)
+{
+  GstVideoMeta *meta;
+
+  if (!gst_buffer_is_writable (inbuf))
+    return FALSE;
+
+  meta = gst_buffer_get_video_meta (inbuf);
+  return meta == NULL || !GST_META_FLAG_IS_SET (meta, GST_META_FLAG_POOLED);
+}
+
+/* In place and crop mode hand the input buffer on when possible: in place
+ * scaling writes into it, a crop meta only marks the window. Anything else
+ * takes an output buffer from the pool like the scale mode.
+ */
+static GstFlowReturn
+gst_libyuvscaler_prepare_output_buffer (GstBaseTransform * trans,
+    GstBuffer * inbuf, GstBuffer ** outbuf)
+{
+  Gstlibyuvscaler *scaler = GST_LIBYUVSCALER_CAST (trans);
+
+  if (gst_base_transform_is_passthrough (trans))
+    goto done;
+
+  switch (scaler->mode) {
+    case GST_LIBYUVSCALER_MODE_IN_PLACE:
+      if (gst_libyuvscaler_can_reuse_input (inbuf)) {
+        *outbuf = inbuf;
+        return GST_FLOW_OK;
+      }
+      GST_CAT_DEBUG_OBJECT (GST_CAT_PERFORMANCE, scaler,
+          "input buffer is shared, scaling into a new buffer");
+      break;
+
+    case GST_LIBYUVSCALER_MODE_CROP:
+      if (!scaler->crop_meta)
+        break;
+      /* only the metas are written, a shared input is shared on */
+      if (gst_buffer_is_writable (inbuf))
+        *outbuf = inbuf;
+      else
+        *outbuf = gst_buffer_copy (inbuf);
+      return GST_FLOW_OK;
+
+    default:
+      break;
+  }
+
+done:
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->prepare_output_buffer
+      (trans, inbuf, outbuf);
+}
+
+static GstFlowReturn
+gst_libyuvscaler_transform (GstBaseTransform * trans, GstBuffer * inbuf,
+    GstBuffer * outbuf)
+{
+  Gstlibyuvscaler *scaler = GST_LIBYUVSCALER_CAST (trans);
+
+  if (scaler->mode == GST_LIBYUVSCALER_MODE_CROP && scaler->crop_meta)
+    return gst_libyuvscaler_add_crop_meta (scaler, outbuf);
+
+  if (scaler->mode == GST_LIBYUVSCALER_MODE_IN_PLACE && outbuf == inbuf)
+    return gst_libyuvscaler_scale_in_place (scaler, outbuf);
+
+  /* the pool path, GstVideoFilter maps both frames for transform_frame */
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->transform (trans, inbuf,
+      outbuf);
+}
+
+/* resolves the auto method for the given sizes. Large downscales need a box
+ * filter to avoid aliasing and it is also the cheapest there; close to 1:1
+ * a horizontal linear filter is enough.
+ */
+GstlibyuvscalerMethod
+gst_libyuvscaler_choose_filter (GstlibyuvscalerMethod method,
+    GstVideoInfo * in_info, GstVideoInfo * out_info)
+{
+  gdouble ratio;
+
+  if (method != GST_LIBYUVSCALER_METHOD_AUTO)
+    return method;
+
+  /* the larger of the two downscale factors, < 1 when upscaling */
+  ratio = MAX ((gdouble) in_info->width / out_info->width,
+      (gdouble) in_info->height / out_info->height);
+
+  if (ratio >= 2.0)
+    return GST_LIBYUVSCALER_METHOD_BOX;
+  if (ratio >= 0.8 && ratio <= 1.25)
+    return GST_LIBYUVSCALER_METHOD_LINEAR;
+  return GST_LIBYUVSCALER_METHOD_BILINEAR;
+}
+
 static gboolean
 gst_libyuvscaler_set_info (GstVideoFilter * filter,
   GstCaps * incaps, GstVideoInfo * in_info, GstCaps * outcaps,
   GstVideoInfo * out_info)
 {
   Gstlibyuvscaler *scaler = GST_LIBYUVSCALER_CAST (filter);
+  gboolean in_place, crop_only, same_size;
+  GstlibyuvscalerMethod method;
 
   if (in_info->fps_n != out_info->fps_n || in_info->fps_d != out_info->fps_d)
     goto format_mismatch;
@@ -314,10 +677,37 @@ gst_libyuvscaler_set_info (GstVideoFilter * filter,
   if (in_info->interlace_mode != out_info->interlace_mode)
     goto format_mismatch;
 
-  if (in_info->width == out_info->width && in_info->height == out_info->height) {
-    gst_base_transform_set_passthrough (GST_BASE_TRANSFORM (filter), TRUE);
+  GST_OBJECT_LOCK (scaler);
+  in_place = scaler->in_place;
+  crop_only = scaler->crop_only;
+  method = scaler->method;
+  GST_OBJECT_UNLOCK (scaler);
+
+  scaler->filter = gst_libyuvscaler_choose_filter (method, in_info, out_info);
+
+  scaler->mode = GST_LIBYUVSCALER_MODE_SCALE;
+
+  same_size = (in_info->width == out_info->width &&
+      in_info->height == out_info->height);
+
+  if (!same_size && in_info->width >= out_info->width &&
+      in_info->height >= out_info->height) {
+    /* shrinking, the output fits in the input buffer */
+    if (crop_only)
+      scaler->mode = GST_LIBYUVSCALER_MODE_CROP;
+    else if (in_place && in_info->width % out_info->width == 0 &&
+        in_info->height % out_info->height == 0)
+      scaler->mode = GST_LIBYUVSCALER_MODE_IN_PLACE;
   }
 
+  /* not flagged in place to the base class: we still need the allocation
+   * for inputs that are shared, see prepare_output_buffer */
+  gst_base_transform_set_passthrough (GST_BASE_TRANSFORM (filter), same_size);
+
+  GST_DEBUG_OBJECT (scaler, "%dx%d -> %dx%d, mode %d, filter %d",
+      in_info->width, in_info->height, out_info->width, out_info->height,
+      scaler->mode, scaler->filter);
+
   return TRUE;
 
       /* ERRORS */
@@ -478,6 +868,45 @@ gst_libyuvscaler_fixate_caps (GstBaseTransform * trans, GstPadDirection directio
   return result;
 }
 
+/* offer upstream a pool with padded strides for our input */
+static gboolean
+gst_libyuvscaler_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query)
+{
+  if (!GST_BASE_TRANSFORM_CLASS (parent_class)->propose_allocation (trans,
+          decide_query, query))
+    return FALSE;
+
+  /* in passthrough and in place upstream allocates for downstream and the
+   * proxied pool is downstream's, leave it alone */
+  if (decide_query == NULL || gst_base_transform_is_passthrough (trans))
+    return TRUE;
+
+  return gst_libyuv_propose_allocation (GST_OBJECT_CAST (trans), query);
+}
+
+static gboolean
+gst_libyuvscaler_decide_allocation (GstBaseTransform * trans, GstQuery * query)
+{
+  Gstlibyuvscaler *scaler = GST_LIBYUVSCALER_CAST (trans);
+
+  /* a crop meta is only understood together with the video meta that
+   * describes the full frame under it */
+  scaler->crop_meta = gst_query_find_allocation_meta (query,
+      GST_VIDEO_META_API_TYPE, NULL) &&
+      gst_query_find_allocation_meta (query, GST_VIDEO_CROP_META_API_TYPE,
+      NULL);
+
+  GST_DEBUG_OBJECT (scaler, "downstream %s crop meta",
+      scaler->crop_meta ? "supports" : "does not support");
+
+  if (!gst_libyuv_decide_allocation (GST_OBJECT_CAST (trans), query))
+    return FALSE;
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->decide_allocation (trans,
+      query);
+}
+
 static gboolean
 gst_libyuvscaler_filter_meta (GstBaseTransform * trans, GstQuery * query,
     GType api, const GstStructure * params)
@@ -515,8 +944,12 @@ plugin_init (GstPlugin * plugin)
   /* initialize gst controller library */
   GST_DEBUG_CATEGORY_INIT (gst_libyuvscaler_debug, "libyuvscaler", 0, "Scales I420 frames using libyuv");
 
-  return gst_element_register (plugin, "libyuvscaler", GST_RANK_NONE,
-      GST_TYPE_LIBYUVSCALER);
+  if (!gst_element_register (plugin, "libyuvscaler", GST_RANK_NONE,
+          GST_TYPE_LIBYUVSCALER))
+    return FALSE;
+
+  return gst_element_register (plugin, "libyuvladder", GST_RANK_NONE,
+      GST_TYPE_LIBYUVLADDER);
 }
 
 
@@ -63,9 +63,36 @@ G_BEGIN_DECLS
 typedef struct _Gstlibyuvscaler      Gstlibyuvscaler;
 typedef struct _GstlibyuvscalerClass GstlibyuvscalerClass;
 
+/* scaling filter, the first four match libyuv's FilterMode */
+typedef enum
+{
+  GST_LIBYUVSCALER_METHOD_NONE,
+  GST_LIBYUVSCALER_METHOD_LINEAR,
+  GST_LIBYUVSCALER_METHOD_BILINEAR,
+  GST_LIBYUVSCALER_METHOD_BOX,
+  GST_LIBYUVSCALER_METHOD_AUTO      /* pick one from the scale ratio */
+} GstlibyuvscalerMethod;
+
+/* how a frame is produced, decided in set_info */
+typedef enum
+{
+  GST_LIBYUVSCALER_MODE_SCALE,      /* scale into a new output buffer */
+  GST_LIBYUVSCALER_MODE_IN_PLACE,   /* scale into the front of the input */
+  GST_LIBYUVSCALER_MODE_CROP        /* no scaling, cut the output window */
+} GstlibyuvscalerMode;
+
 struct _Gstlibyuvscaler
 {
   GstVideoFilter element;
+
+  /* properties */
+  gboolean in_place;
+  gboolean crop_only;
+  GstlibyuvscalerMethod method;
+
+  GstlibyuvscalerMode mode;
+  GstlibyuvscalerMethod filter; /* method resolved for the negotiated sizes */
+  gboolean crop_meta;           /* downstream takes GstVideoCropMeta */
 };
 
 struct _GstlibyuvscalerClass
@@ -73,6 +100,15 @@ struct _GstlibyuvscalerClass
   GstVideoFilterClass parent_class;
 };
 
+GType gst_libyuvscaler_get_type (void);
+
+/* shared with libyuvladder */
+void gst_libyuvscaler_scale_planes (GstVideoFrame * in_frame, guint8 * out[3],
+    gint out_stride, gint out_uv_stride, gint out_width, gint out_height,
+    GstlibyuvscalerMethod filter);
+GstlibyuvscalerMethod gst_libyuvscaler_choose_filter (
+    GstlibyuvscalerMethod method, GstVideoInfo * in_info,
+    GstVideoInfo * out_info);
 
 G_END_DECLS
 
@@ -26,6 +26,9 @@
  * Differs from videoconvert plug is that libyuv supports
  * hardware acceleration.
  *
+ * Buffer lists are converted as one batch, the frames of the list are
+ * spread over #GstRgbToYuv:n-threads threads and pushed on as a list.
+ *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
@@ -41,6 +44,7 @@
 #endif
 
 #include "gstrgbtoyuv.h"
+#include "gstlibyuvpool.h"
 
 #include <gst/video/video.h>
 #include <gst/video/gstvideometa.h>
@@ -71,9 +75,13 @@ enum
 
 enum
 {
-  PROP_0
+  PROP_0,
+  PROP_N_THREADS
 };
 
+#define DEFAULT_N_THREADS 1
+#define GST_RGBTOYUV_MAX_THREADS 64
+
 
 /* the capabilities of the inputs and outputs.
  *
@@ -105,6 +113,7 @@ static void gst_rgb_to_yuv_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec);
 static void gst_rgb_to_yuv_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec);
+static void gst_rgb_to_yuv_finalize (GObject * object);
 
 
 /* GObject vmethod implementations */
@@ -115,6 +124,12 @@ static GstCaps * gst_rgb_to_yuv_transform_caps (GstBaseTransform * btrans,
 static GstCaps * gst_rgb_to_yuv_fixate_caps (GstBaseTransform * trans,
     GstPadDirection direction, GstCaps * caps, GstCaps * othercaps);
 
+static gboolean gst_rgb_to_yuv_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query);
+
+static gboolean gst_rgb_to_yuv_decide_allocation (GstBaseTransform * trans,
+    GstQuery * query);
+
 static gboolean gst_rgb_to_yuv_filter_meta (GstBaseTransform * trans, GstQuery * query,
     GType api, const GstStructure * params);
 
@@ -128,6 +143,17 @@ static gboolean gst_rgb_to_yuv_set_info (GstVideoFilter * filter,
 static GstFlowReturn gst_rgb_to_yuv_transform_frame (GstVideoFilter *filter,
   GstVideoFrame *in_frame, GstVideoFrame *out_frame);
 
+static gboolean gst_rgb_to_yuv_start (GstBaseTransform * trans);
+static gboolean gst_rgb_to_yuv_stop (GstBaseTransform * trans);
+static gboolean gst_rgb_to_yuv_sink_event (GstBaseTransform * trans,
+    GstEvent * event);
+static gboolean gst_rgb_to_yuv_src_event (GstBaseTransform * trans,
+    GstEvent * event);
+
+static GstFlowReturn gst_rgb_to_yuv_chain_list (GstPad * pad,
+    GstObject * parent, GstBufferList * list);
+static void gst_rgb_to_yuv_worker_func (gpointer data, gpointer user_data);
+
 
 /* initialize the rgbtoyuv's class */
 static void
@@ -140,6 +166,15 @@ gst_rgb_to_yuv_class_init (GstRgbToYuvClass * klass)
 
   gobject_class->set_property = gst_rgb_to_yuv_set_property;
   gobject_class->get_property = gst_rgb_to_yuv_get_property;
+  gobject_class->finalize = gst_rgb_to_yuv_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_N_THREADS,
+      g_param_spec_uint ("n-threads", "Threads",
+          "Number of threads converting the frames of a buffer list in "
+          "parallel (0 = number of processors)", 0, GST_RGBTOYUV_MAX_THREADS,
+          DEFAULT_N_THREADS,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              GST_PARAM_MUTABLE_READY)));
 
   gst_element_class_add_pad_template (gstelement_class,
       gst_static_pad_template_get (&gst_rgbtoyuv_src_template));
@@ -157,12 +192,25 @@ gst_rgb_to_yuv_class_init (GstRgbToYuvClass * klass)
   gstbasetransform_class->fixate_caps =
       GST_DEBUG_FUNCPTR (gst_rgb_to_yuv_fixate_caps);
 
+  gstbasetransform_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_rgb_to_yuv_propose_allocation);
+  gstbasetransform_class->decide_allocation =
+      GST_DEBUG_FUNCPTR (gst_rgb_to_yuv_decide_allocation);
   gstbasetransform_class->filter_meta =
       GST_DEBUG_FUNCPTR (gst_rgb_to_yuv_filter_meta);
 
   gstbasetransform_class->transform_meta =
       GST_DEBUG_FUNCPTR (gst_rgb_to_yuv_transform_meta);
 
+  gstbasetransform_class->start =
+      GST_DEBUG_FUNCPTR (gst_rgb_to_yuv_start);
+  gstbasetransform_class->stop =
+      GST_DEBUG_FUNCPTR (gst_rgb_to_yuv_stop);
+  gstbasetransform_class->sink_event =
+      GST_DEBUG_FUNCPTR (gst_rgb_to_yuv_sink_event);
+  gstbasetransform_class->src_event =
+      GST_DEBUG_FUNCPTR (gst_rgb_to_yuv_src_event);
+
   gstbasetransform_class->passthrough_on_same_caps = TRUE;
 
   gstvideofilter_class->set_info =
@@ -184,28 +232,175 @@ gst_rgb_to_yuv_class_init (GstRgbToYuvClass * klass)
 static void
 gst_rgb_to_yuv_init (GstRgbToYuv *filter)
 {
+  GstPad *sinkpad = GST_BASE_TRANSFORM_SINK_PAD (filter);
+
+  filter->n_threads = DEFAULT_N_THREADS;
+  filter->convert = NULL;
+  filter->n_workers = 1;
+  filter->pool = NULL;
+  filter->pending = 0;
+  filter->jobs = NULL;
+  filter->n_jobs = 0;
+  filter->next_job = 0;
+  filter->earliest_time = GST_CLOCK_TIME_NONE;
+
+  g_mutex_init (&filter->lock);
+  g_cond_init (&filter->cond);
+
+  /* buffer lists are converted as one batch, single buffers still go
+   * through the base class */
+  filter->base_chain = GST_PAD_CHAINFUNC (sinkpad);
+  gst_pad_set_chain_list_function (sinkpad,
+      GST_DEBUG_FUNCPTR (gst_rgb_to_yuv_chain_list));
+}
+
+static void
+gst_rgb_to_yuv_finalize (GObject * object)
+{
+  GstRgbToYuv *rgbtoyuv = GST_RGBTOYUV (object);
+
+  g_mutex_clear (&rgbtoyuv->lock);
+  g_cond_clear (&rgbtoyuv->cond);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
 static void
 gst_rgb_to_yuv_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec)
 {
+  GstRgbToYuv *rgbtoyuv = GST_RGBTOYUV (object);
+
+  switch (prop_id) {
+    case PROP_N_THREADS:
+      GST_OBJECT_LOCK (rgbtoyuv);
+      rgbtoyuv->n_threads = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (rgbtoyuv);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
 }
 
 static void
 gst_rgb_to_yuv_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec)
 {
+  GstRgbToYuv *rgbtoyuv = GST_RGBTOYUV (object);
+
+  switch (prop_id) {
+    case PROP_N_THREADS:
+      GST_OBJECT_LOCK (rgbtoyuv);
+      g_value_set_uint (value, rgbtoyuv->n_threads);
+      GST_OBJECT_UNLOCK (rgbtoyuv);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+/* spawn the worker threads once, they stay around until stop () so that
+ * no thread is created on the streaming path */
+static gboolean
+gst_rgb_to_yuv_start (GstBaseTransform * trans)
+{
+  GstRgbToYuv *rgbtoyuv = GST_RGBTOYUV_CAST (trans);
+  GError *err = NULL;
+  guint n_threads;
+
+  GST_OBJECT_LOCK (rgbtoyuv);
+  n_threads = rgbtoyuv->n_threads;
+  GST_OBJECT_UNLOCK (rgbtoyuv);
+
+  if (n_threads == 0)
+    n_threads = MIN (g_get_num_processors (), GST_RGBTOYUV_MAX_THREADS);
+
+  rgbtoyuv->n_workers = n_threads;
+  rgbtoyuv->pending = 0;
+
+  GST_OBJECT_LOCK (rgbtoyuv);
+  rgbtoyuv->earliest_time = GST_CLOCK_TIME_NONE;
+  GST_OBJECT_UNLOCK (rgbtoyuv);
+
+  if (n_threads > 1) {
+    /* the streaming thread converts frames of the batch too */
+    rgbtoyuv->pool = g_thread_pool_new (gst_rgb_to_yuv_worker_func, rgbtoyuv,
+        n_threads - 1, TRUE, &err);
+    if (rgbtoyuv->pool == NULL) {
+      GST_WARNING_OBJECT (rgbtoyuv, "failed to create worker pool: %s",
+          err->message);
+      g_clear_error (&err);
+      rgbtoyuv->n_workers = 1;
+    }
+  }
+
+  GST_DEBUG_OBJECT (rgbtoyuv, "converting batches with %u thread(s)",
+      rgbtoyuv->n_workers);
+
+  return TRUE;
+}
+
+static gboolean
+gst_rgb_to_yuv_stop (GstBaseTransform * trans)
+{
+  GstRgbToYuv *rgbtoyuv = GST_RGBTOYUV_CAST (trans);
+
+  if (rgbtoyuv->pool) {
+    g_thread_pool_free (rgbtoyuv->pool, FALSE, TRUE);
+    rgbtoyuv->pool = NULL;
+  }
+  rgbtoyuv->n_workers = 1;
+
+  return TRUE;
+}
+
+static gboolean
+gst_rgb_to_yuv_sink_event (GstBaseTransform * trans, GstEvent * event)
+{
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_STOP:
+    case GST_EVENT_SEGMENT:
+      GST_OBJECT_LOCK (trans);
+      GST_RGBTOYUV_CAST (trans)->earliest_time = GST_CLOCK_TIME_NONE;
+      GST_OBJECT_UNLOCK (trans);
+      break;
+    default:
+      break;
+  }
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->sink_event (trans, event);
+}
+
+/* keeps the deadline of the QoS events so the batch can leave frames the
+ * base class would drop to it, the base class keeps its own copy */
+static gboolean
+gst_rgb_to_yuv_src_event (GstBaseTransform * trans, GstEvent * event)
+{
+  GstClockTimeDiff diff;
+  GstClockTime timestamp;
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_QOS) {
+    gst_event_parse_qos (event, NULL, NULL, &diff, &timestamp);
+
+    GST_OBJECT_LOCK (trans);
+    if (diff >= 0 || timestamp >= (GstClockTime) (-diff))
+      GST_RGBTOYUV_CAST (trans)->earliest_time = timestamp + diff;
+    else
+      GST_RGBTOYUV_CAST (trans)->earliest_time = 0;
+    GST_OBJECT_UNLOCK (trans);
+  }
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->src_event (trans, event);
 }
 
 /* GstBaseTransform vmethod implementations */
 
-/* this function does the actual processing
- */
-static GstFlowReturn
-gst_rgb_to_yuv_transform_frame (GstVideoFilter *filter, GstVideoFrame *in_frame, GstVideoFrame *out_frame)
+static void
+gst_rgb_to_yuv_convert (GstRgbToYuv * rgbtoyuv, GstVideoFrame * in_frame,
+    GstVideoFrame * out_frame)
 {
-  GstRgbToYuv *rgbtoyuv = GST_RGBTOYUV_CAST (filter);
   gint width, height, stride;
   gint y_stride, uv_stride;
   guint32 *in_data;
@@ -224,45 +419,342 @@ gst_rgb_to_yuv_transform_frame (GstVideoFilter *filter, GstVideoFrame *in_frame,
   u_out = (guint8*) GST_VIDEO_FRAME_PLANE_DATA (out_frame, 1);
   v_out = (guint8*) GST_VIDEO_FRAME_PLANE_DATA (out_frame, 2);
 
-  GST_INFO ("DEBUG_INFO: rgbtoyuv::transform_frame: ");
-  GST_INFO ("in stride: %d; out stride: %d %d\n", stride, y_stride, uv_stride);
+  rgbtoyuv->convert ((guint8 *)(in_data), stride,
+              y_out, y_stride,
+              u_out, uv_stride,
+              v_out, uv_stride,
+              width, height);
+}
 
-  switch (GST_VIDEO_FRAME_FORMAT (in_frame)) {
-    case GST_VIDEO_FORMAT_RGBA:
-    case GST_VIDEO_FORMAT_BGRA:
-    GST_INFO("DEBUG_INFO: rgbtoyuv input format RGBA.\n");
-    libyuv::RGBAToI420 ((guint8 *)(in_data), stride,
-                y_out, y_stride,
-                u_out, uv_stride,
-                v_out, uv_stride,
-                width, height);
-    break;
+/* this function does the actual processing
+ */
+static GstFlowReturn
+gst_rgb_to_yuv_transform_frame (GstVideoFilter *filter, GstVideoFrame *in_frame, GstVideoFrame *out_frame)
+{
+  GstRgbToYuv *rgbtoyuv = GST_RGBTOYUV_CAST (filter);
+
+  GST_LOG ("in stride: %d; out stride: %d %d",
+      GST_VIDEO_FRAME_PLANE_STRIDE (in_frame, 0),
+      GST_VIDEO_FRAME_PLANE_STRIDE (out_frame, 0),
+      GST_VIDEO_FRAME_PLANE_STRIDE (out_frame, 1));
+
+  gst_rgb_to_yuv_convert (rgbtoyuv, in_frame, out_frame);
+
+  return GST_FLOW_OK;
+}
+
+/* takes frames of the current batch until none are left. Run by the
+ * streaming thread and by each worker of the pool.
+ */
+static void
+gst_rgb_to_yuv_convert_jobs (GstRgbToYuv * rgbtoyuv)
+{
+  gint i;
+
+  while ((i = g_atomic_int_add (&rgbtoyuv->next_job, 1)) < rgbtoyuv->n_jobs)
+    gst_rgb_to_yuv_convert (rgbtoyuv, &rgbtoyuv->jobs[i].in_frame,
+        &rgbtoyuv->jobs[i].out_frame);
+}
+
+/* runs in a worker thread of the pool */
+static void
+gst_rgb_to_yuv_worker_func (gpointer data, gpointer user_data)
+{
+  GstRgbToYuv *rgbtoyuv = GST_RGBTOYUV_CAST (user_data);
+
+  gst_rgb_to_yuv_convert_jobs (rgbtoyuv);
+
+  g_mutex_lock (&rgbtoyuv->lock);
+  if (--rgbtoyuv->pending == 0)
+    g_cond_signal (&rgbtoyuv->cond);
+  g_mutex_unlock (&rgbtoyuv->lock);
+}
+
+/* converts the mapped frames in jobs[0..n_jobs) on all workers at once */
+static void
+gst_rgb_to_yuv_convert_batch (GstRgbToYuv * rgbtoyuv, GstRgbToYuvJob * jobs,
+    gint n_jobs)
+{
+  guint i, n_workers;
+
+  rgbtoyuv->jobs = jobs;
+  rgbtoyuv->n_jobs = n_jobs;
+  g_atomic_int_set (&rgbtoyuv->next_job, 0);
+
+  n_workers = rgbtoyuv->pool ? MIN (rgbtoyuv->n_workers, (guint) n_jobs) : 1;
+
+  if (n_workers > 1) {
+    g_mutex_lock (&rgbtoyuv->lock);
+    rgbtoyuv->pending = n_workers - 1;
+    g_mutex_unlock (&rgbtoyuv->lock);
+
+    /* the pool needs a non-NULL item, the jobs are shared */
+    for (i = 1; i < n_workers; i++)
+      g_thread_pool_push (rgbtoyuv->pool, rgbtoyuv, NULL);
+  }
+
+  gst_rgb_to_yuv_convert_jobs (rgbtoyuv);
 
+  if (n_workers > 1) {
+    g_mutex_lock (&rgbtoyuv->lock);
+    while (rgbtoyuv->pending > 0)
+      g_cond_wait (&rgbtoyuv->cond, &rgbtoyuv->lock);
+    g_mutex_unlock (&rgbtoyuv->lock);
+  }
+
+  rgbtoyuv->jobs = NULL;
+  rgbtoyuv->n_jobs = 0;
+}
+
+/* feeds buffers [start, end) of the list to the base class one by one */
+static GstFlowReturn
+gst_rgb_to_yuv_chain_each (GstRgbToYuv * rgbtoyuv, GstPad * pad,
+    GstObject * parent, GstBufferList * list, guint start, guint end)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint i;
+
+  for (i = start; i < end && ret == GST_FLOW_OK; i++)
+    ret = rgbtoyuv->base_chain (pad, parent,
+        gst_buffer_ref (gst_buffer_list_get (list, i)));
+
+  return ret;
+}
+
+/* how many output buffers may be held at once without starving the
+ * output pool. Downstream may still hold one of them. */
+static guint
+gst_rgb_to_yuv_max_batch (GstRgbToYuv * rgbtoyuv, guint n)
+{
+  GstBufferPool *pool;
+  GstStructure *config;
+  guint max = 0;
+
+  pool = gst_base_transform_get_buffer_pool (GST_BASE_TRANSFORM (rgbtoyuv));
+  if (pool) {
+    config = gst_buffer_pool_get_config (pool);
+    gst_buffer_pool_config_get_params (config, NULL, NULL, NULL, &max);
+    gst_structure_free (config);
+    gst_object_unref (pool);
+  }
+
+  if (max == 0)
+    return n;
+  return MIN (n, MAX (max - 1, 1));
+}
+
+/* whether buf can join a batch. Gaps, frames QoS would drop and anything
+ * after a reconfigure request are left to the base class.
+ */
+static gboolean
+gst_rgb_to_yuv_can_batch (GstRgbToYuv * rgbtoyuv, GstBuffer * buf)
+{
+  GstBaseTransform *trans = GST_BASE_TRANSFORM_CAST (rgbtoyuv);
+  GstClockTime earliest, running_time;
+
+  if (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_GAP))
+    return FALSE;
+
+  if (gst_pad_needs_reconfigure (GST_BASE_TRANSFORM_SRC_PAD (trans)))
+    return FALSE;
+
+  if (!gst_base_transform_is_qos_enabled (trans) ||
+      !GST_BUFFER_TIMESTAMP_IS_VALID (buf))
+    return TRUE;
+
+  GST_OBJECT_LOCK (rgbtoyuv);
+  earliest = rgbtoyuv->earliest_time;
+  GST_OBJECT_UNLOCK (rgbtoyuv);
+
+  if (!GST_CLOCK_TIME_IS_VALID (earliest))
+    return TRUE;
+
+  running_time = gst_segment_to_running_time (&trans->segment,
+      GST_FORMAT_TIME, GST_BUFFER_TIMESTAMP (buf));
+
+  return !GST_CLOCK_TIME_IS_VALID (running_time) || running_time > earliest;
+}
+
+/* converts a buffer list in batches: the output buffers are prepared and
+ * the frames mapped first, then the frames are spread over the workers
+ * with one frame per worker at a time, and the result is pushed as a
+ * list. The first buffer goes through the base class so that any pending
+ * renegotiation and the allocation are done the usual way, as does every
+ * buffer the batch can not take, after the frames before it are pushed.
+ */
+static GstFlowReturn
+gst_rgb_to_yuv_chain_list (GstPad * pad, GstObject * parent,
+    GstBufferList * list)
+{
+  GstRgbToYuv *rgbtoyuv = GST_RGBTOYUV_CAST (parent);
+  GstBaseTransform *trans = GST_BASE_TRANSFORM_CAST (parent);
+  GstVideoFilter *filter = GST_VIDEO_FILTER_CAST (parent);
+  GstBaseTransformClass *bclass = GST_BASE_TRANSFORM_GET_CLASS (trans);
+  GstFlowReturn ret;
+  GstRgbToYuvJob *jobs;
+  GstBufferList *outlist;
+  GstBuffer *inbuf, *outbuf;
+  guint i, n, next, batch, mapped;
+
+  n = gst_buffer_list_length (list);
+
+  ret = gst_rgb_to_yuv_chain_each (rgbtoyuv, pad, parent, list, 0, MIN (n, 1));
+  if (ret != GST_FLOW_OK || n <= 1)
+    goto done;
+
+  if (gst_base_transform_is_passthrough (trans) || !filter->negotiated) {
+    ret = gst_rgb_to_yuv_chain_each (rgbtoyuv, pad, parent, list, 1, n);
+    goto done;
+  }
+
+  batch = gst_rgb_to_yuv_max_batch (rgbtoyuv, n - 1);
+  jobs = g_new (GstRgbToYuvJob, batch);
+
+  next = 1;
+  while (next < n && ret == GST_FLOW_OK) {
+    outlist = gst_buffer_list_new_sized (batch);
+
+    for (mapped = 0; mapped < batch && next < n; mapped++, next++) {
+      inbuf = gst_buffer_list_get (list, next);
+      if (!gst_rgb_to_yuv_can_batch (rgbtoyuv, inbuf))
+        break;
+
+      /* OK without a buffer means the base class wants this one */
+      outbuf = NULL;
+      ret = bclass->prepare_output_buffer (trans, inbuf, &outbuf);
+      if (ret != GST_FLOW_OK || outbuf == NULL)
+        break;
+      gst_buffer_list_add (outlist, outbuf);
+
+      if (!gst_video_frame_map (&jobs[mapped].in_frame, &filter->in_info,
+              inbuf, GST_MAP_READ))
+        goto map_failed;
+      if (!gst_video_frame_map (&jobs[mapped].out_frame, &filter->out_info,
+              outbuf, GST_MAP_WRITE)) {
+        gst_video_frame_unmap (&jobs[mapped].in_frame);
+        goto map_failed;
+      }
+    }
+
+    if (mapped > 0) {
+      GST_LOG_OBJECT (rgbtoyuv, "converting %u frames", mapped);
+      gst_rgb_to_yuv_convert_batch (rgbtoyuv, jobs, mapped);
+
+      for (i = 0; i < mapped; i++) {
+        gst_video_frame_unmap (&jobs[i].in_frame);
+        gst_video_frame_unmap (&jobs[i].out_frame);
+      }
+    }
+
+    if (ret == GST_FLOW_OK && mapped > 0)
+      ret = gst_pad_push_list (GST_BASE_TRANSFORM_SRC_PAD (trans), outlist);
+    else
+      gst_buffer_list_unref (outlist);
+
+    /* the buffer that ended the batch early */
+    if (ret == GST_FLOW_OK && mapped < batch && next < n) {
+      ret = gst_rgb_to_yuv_chain_each (rgbtoyuv, pad, parent, list, next,
+          next + 1);
+      next++;
+
+      /* it may have renegotiated */
+      if (ret == GST_FLOW_OK && (gst_base_transform_is_passthrough (trans) ||
+              !filter->negotiated)) {
+        ret = gst_rgb_to_yuv_chain_each (rgbtoyuv, pad, parent, list, next,
+            n);
+        break;
+      }
+      batch = MIN (batch, gst_rgb_to_yuv_max_batch (rgbtoyuv, n - 1));
+    }
+  }
+
+  g_free (jobs);
+
+done:
+  gst_buffer_list_unref (list);
+  return ret;
+
+  /* ERRORS */
+map_failed:
+  {
+    GST_ELEMENT_ERROR (rgbtoyuv, CORE, FAILED, (NULL),
+        ("failed to map frame %u of the buffer list", next));
+    ret = GST_FLOW_ERROR;
+    for (i = 0; i < mapped; i++) {
+      gst_video_frame_unmap (&jobs[i].in_frame);
+      gst_video_frame_unmap (&jobs[i].out_frame);
+    }
+    gst_buffer_list_unref (outlist);
+    g_free (jobs);
+    goto done;
+  }
+}
+
+/* picks the libyuv kernel for the input format and the output colorimetry.
+ * libyuv names packed formats after the 32-bit word, GStreamer after the
+ * byte order in memory, so GStreamer BGRA is libyuv ARGB and so on.
+ * libyuv only has BT.601 coefficients for this direction: full range
+ * (J420) for ARGB and ABGR words, limited range (I420) for everything.
+ */
+static gboolean
+gst_rgb_to_yuv_setup_convert (GstRgbToYuv * rgbtoyuv, GstVideoInfo * in_info,
+    GstVideoInfo * out_info)
+{
+  GstVideoColorimetry *cinfo = &GST_VIDEO_INFO_COLORIMETRY (out_info);
+  gboolean full_range = (cinfo->range == GST_VIDEO_COLOR_RANGE_0_255);
+  GstRgbToYuvFunc convert_full = NULL;
+
+  switch (GST_VIDEO_INFO_FORMAT (in_info)) {
+    case GST_VIDEO_FORMAT_BGRA:
+      rgbtoyuv->convert = libyuv::ARGBToI420;
+      convert_full = libyuv::ARGBToJ420;
+      break;
+    case GST_VIDEO_FORMAT_RGBA:
+      rgbtoyuv->convert = libyuv::ABGRToI420;
+      convert_full = libyuv::ABGRToJ420;
+      break;
     case GST_VIDEO_FORMAT_ARGB:
+      rgbtoyuv->convert = libyuv::BGRAToI420;
+      break;
     case GST_VIDEO_FORMAT_ABGR:
-    GST_INFO ("DEBUG_INFO: rgbtoyuv input format ARGB.\n");
-    libyuv::ARGBToI420 ((guint8 *)(in_data), stride,
-                y_out, y_stride,
-                u_out, uv_stride,
-                v_out, uv_stride,
-                width, height);
-    break;
-
+      rgbtoyuv->convert = libyuv::RGBAToI420;
+      break;
     case GST_VIDEO_FORMAT_RGB16:
-    GST_INFO("DEBUG_INFO: rgbtoyuv input format RGB16.\n");
-    libyuv::RGB565ToI420 ((guint8 *)(in_data), stride,
-                y_out, y_stride,
-                u_out, uv_stride,
-                v_out, uv_stride,
-                width, height);
-    break;
-
+      rgbtoyuv->convert = libyuv::RGB565ToI420;
+      break;
     default:
-    return GST_FLOW_ERROR;
-    break;
+      GST_ERROR_OBJECT (rgbtoyuv, "unsupported input format %s",
+          gst_video_format_to_string (GST_VIDEO_INFO_FORMAT (in_info)));
+      return FALSE;
   }
 
-  return GST_FLOW_OK;
+  /* transform_caps only offers these, refuse anything else rather than
+   * label BT.601 data with another matrix */
+  if (cinfo->matrix != GST_VIDEO_COLOR_MATRIX_BT601 &&
+      cinfo->matrix != GST_VIDEO_COLOR_MATRIX_UNKNOWN)
+    goto wrong_matrix;
+
+  if (full_range) {
+    if (convert_full == NULL)
+      goto no_full_range;
+    rgbtoyuv->convert = convert_full;
+  }
+
+  return TRUE;
+
+  /* ERRORS */
+wrong_matrix:
+  {
+    GST_ERROR_OBJECT (rgbtoyuv, "no libyuv kernel for matrix %d, only "
+        "BT.601", cinfo->matrix);
+    return FALSE;
+  }
+no_full_range:
+  {
+    GST_ERROR_OBJECT (rgbtoyuv, "no full range kernel for %s",
+        gst_video_format_to_string (GST_VIDEO_INFO_FORMAT (in_info)));
+    return FALSE;
+  }
 }
 
 static gboolean
@@ -284,6 +776,9 @@ gst_rgb_to_yuv_set_info (GstVideoFilter * filter,
   if (in_info->interlace_mode != out_info->interlace_mode)
     goto format_mismatch;
 
+  if (!gst_rgb_to_yuv_setup_convert (rgbtoyuv, in_info, out_info))
+    return FALSE;
+
   GST_DEBUG ("reconfigured %d %d", GST_VIDEO_INFO_FORMAT (in_info),
       GST_VIDEO_INFO_FORMAT (out_info));
 
@@ -298,10 +793,41 @@ format_mismatch:
 }
 
 
-/* copies the given caps */
+/* the output colorimetry the kernels can write from the format of @in:
+ * BT.601, and full range BT.601 (J420) only from a fixed BGRA or RGBA */
+static void
+gst_rgb_to_yuv_set_colorimetry (GstStructure * out, const GstStructure * in)
+{
+  const gchar *format = gst_structure_get_string (in, "format");
+  GstVideoColorimetry full = { GST_VIDEO_COLOR_RANGE_0_255,
+    GST_VIDEO_COLOR_MATRIX_BT601, GST_VIDEO_TRANSFER_UNKNOWN,
+    GST_VIDEO_COLOR_PRIMARIES_UNKNOWN };
+  GValue list = G_VALUE_INIT;
+  GValue val = G_VALUE_INIT;
+
+  if (format == NULL || (strcmp (format, "BGRA") && strcmp (format, "RGBA"))) {
+    gst_structure_set (out, "colorimetry", G_TYPE_STRING,
+        GST_VIDEO_COLORIMETRY_BT601, NULL);
+    return;
+  }
+
+  g_value_init (&list, GST_TYPE_LIST);
+  g_value_init (&val, G_TYPE_STRING);
+  g_value_set_static_string (&val, GST_VIDEO_COLORIMETRY_BT601);
+  gst_value_list_append_value (&list, &val);
+  g_value_take_string (&val, gst_video_colorimetry_to_string (&full));
+  gst_value_list_append_value (&list, &val);
+  g_value_unset (&val);
+  gst_structure_take_value (out, "colorimetry", &list);
+}
+
+/* copies the given caps, restricting the colorimetry of the output when
+ * transforming sink caps */
 static GstCaps *
-gst_rgb_to_yuv_caps_remove_format_info (GstCaps * caps)
+gst_rgb_to_yuv_caps_remove_format_info (GstCaps * caps,
+    GstPadDirection direction)
 {
+  const GstStructure *in;
   GstStructure *st;
   gint i, n;
   GstCaps *res;
@@ -317,9 +843,12 @@ gst_rgb_to_yuv_caps_remove_format_info (GstCaps * caps)
     if (i > 0 && gst_caps_is_subset_structure (res, st))
       continue;
 
-    st = gst_structure_copy (st);
+    in = st;
+    st = gst_structure_copy (in);
     gst_structure_remove_fields (st, "format",
         "colorimetry", "chroma-site", NULL);
+    if (direction == GST_PAD_SINK)
+      gst_rgb_to_yuv_set_colorimetry (st, in);
 
     gst_caps_append_structure (res, st);
   }
@@ -339,7 +868,7 @@ gst_rgb_to_yuv_transform_caps (GstBaseTransform * btrans,
   GstCaps *result;
 
   /* Get all possible caps that we can transform to */
-  tmp = gst_rgb_to_yuv_caps_remove_format_info (caps);
+  tmp = gst_rgb_to_yuv_caps_remove_format_info (caps, direction);
 
   if (filter) {
     tmp2 = gst_caps_intersect_full (filter, tmp, GST_CAPS_INTERSECT_FIRST);
@@ -374,9 +903,47 @@ gst_rgb_to_yuv_fixate_caps (GstBaseTransform * trans,
   /* fixate remaining fields */
   result = gst_caps_fixate (result);
 
+  /* the kernels are BT.601, say so if downstream did not ask for anything
+   * else instead of letting the video info guess from the frame size */
+  if (direction == GST_PAD_SINK && !gst_caps_is_empty (result)) {
+    GstStructure *st = gst_caps_get_structure (result, 0);
+
+    if (!gst_structure_has_field (st, "colorimetry")) {
+      result = gst_caps_make_writable (result);
+      gst_caps_set_simple (result, "colorimetry", G_TYPE_STRING,
+          GST_VIDEO_COLORIMETRY_BT601, NULL);
+    }
+  }
+
   return result;
 }
 
+/* offer upstream a pool with padded strides for our input */
+static gboolean
+gst_rgb_to_yuv_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query)
+{
+  if (!GST_BASE_TRANSFORM_CLASS (parent_class)->propose_allocation (trans,
+          decide_query, query))
+    return FALSE;
+
+  /* in passthrough upstream allocates for downstream */
+  if (gst_base_transform_is_passthrough (trans))
+    return TRUE;
+
+  return gst_libyuv_propose_allocation (GST_OBJECT_CAST (trans), query);
+}
+
+static gboolean
+gst_rgb_to_yuv_decide_allocation (GstBaseTransform * trans, GstQuery * query)
+{
+  if (!gst_libyuv_decide_allocation (GST_OBJECT_CAST (trans), query))
+    return FALSE;
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->decide_allocation (trans,
+      query);
+}
+
 static gboolean
 gst_rgb_to_yuv_filter_meta (GstBaseTransform * trans, GstQuery * query,
     GType api, const GstStructure * params)
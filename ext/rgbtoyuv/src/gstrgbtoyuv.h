@@ -40,8 +40,37 @@ G_BEGIN_DECLS
 typedef struct _GstRgbToYuv      GstRgbToYuv;
 typedef struct _GstRgbToYuvClass GstRgbToYuvClass;
 
+/* signature shared by the libyuv *ToI420 and *ToJ420 kernels */
+typedef int (*GstRgbToYuvFunc) (const guint8 * src, int src_stride,
+    guint8 * dst_y, int dst_stride_y, guint8 * dst_u, int dst_stride_u,
+    guint8 * dst_v, int dst_stride_v, int width, int height);
+
+/* one frame of a buffer list batch */
+typedef struct
+{
+  GstVideoFrame in_frame;
+  GstVideoFrame out_frame;
+} GstRgbToYuvJob;
+
 struct _GstRgbToYuv {
   GstVideoFilter element;
+
+  guint n_threads;            /* requested number of worker threads, 0 = auto */
+
+  GstRgbToYuvFunc convert;    /* kernel chosen in set_info */
+
+  /* buffer list batches, set up in start () */
+  guint n_workers;            /* threads converting a batch, with ours */
+  GThreadPool *pool;          /* persistent workers */
+  GMutex lock;
+  GCond cond;
+  guint pending;              /* workers still busy, protected by lock */
+  GstRgbToYuvJob *jobs;       /* frames of the current batch */
+  gint n_jobs;
+  volatile gint next_job;     /* next frame to take, atomic */
+
+  GstPadChainFunction base_chain;   /* chain function of the base class */
+  GstClockTime earliest_time;       /* from QoS events, object lock */
 };
 
 struct _GstRgbToYuvClass {
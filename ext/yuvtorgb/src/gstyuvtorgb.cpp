@@ -22,12 +22,23 @@
 /**
  * SECTION:element-yuvtorgb
  *
- * Converts I420 to RGB using open source libyuv
+ * Converts I420, NV12, NV21, YUY2, UYVY, Y42B or Y444 to ARGB, BGRA, RGBA,
+ * ABGR, RGB or RGB16 using open source libyuv. I420 has its own libyuv kernel
+ * for each output format; the other inputs go through the matching libyuv
+ * *ToARGB kernel and, unless BGRA is requested, a small strip of cached rows
+ * that is repacked into the output, so every frame is still read and written
+ * only once.
+ *
+ * With #GstYuvToRgb:scale set, I420 input can also be scaled to the output
+ * size on the way. The frame is scaled a few rows at a time into a small
+ * strip that is converted while still in cache, so unlike
+ * libyuvscaler ! yuvtorgb no full size I420 frame is written and read back.
  *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
- * gst-launch -v -m fakesrc ! yuvtorgb ! fakesink silent=TRUE
+ * gst-launch -v -m fakesrc ! yuvtorgb ! video/x-raw,format=BGRA ! fakesink silent=TRUE
+ * gst-launch -v videotestsrc ! video/x-raw,format=I420,width=1920,height=1080 ! yuvtorgb scale=true ! video/x-raw,format=BGRA,width=1280,height=720 ! fakesink
  * ]|
  * </refsect2>
  */
@@ -37,6 +48,7 @@
 #endif
 
 #include "gstyuvtorgb.h"
+#include "gstlibyuvpool.h"
 
 #include <gst/video/video.h>
 #include <gst/video/gstvideometa.h>
@@ -44,9 +56,6 @@
 
 #include <string.h>
 
-/* include libyuv */
-#include "libyuv.h"
-
 
 GST_DEBUG_CATEGORY_STATIC (gst_yuv_to_rgb_debug);
 #define GST_CAT_DEFAULT gst_yuv_to_rgb_debug
@@ -69,13 +78,38 @@ enum
 enum
 {
   PROP_0,
+  PROP_N_THREADS,
+  PROP_SCALE
 };
 
+#define DEFAULT_N_THREADS 1
+#define DEFAULT_SCALE FALSE
+#define GST_YUVTORGB_MAX_THREADS 64
+
+/* rows converted to ARGB before being repacked, kept even for 4:2:0 input */
+#define GST_YUVTORGB_STRIP_ROWS 8
+
+/* strips of scaled rows, aligned ratios use at least the minimum so the
+ * overlap stays a small part of the work, others are cut at the maximum */
+#define GST_YUVTORGB_SCALE_MIN_ROWS 16
+#define GST_YUVTORGB_SCALE_MAX_ROWS 64
+
+/* one horizontal slice of a frame, converted by a single thread */
+typedef struct
+{
+  GstYuvToRgb *yuvtorgb;
+  GstVideoFrame *in_frame;
+  GstVideoFrame *out_frame;
+  guint8 *scratch;
+  gint y;
+  gint height;
+} GstYuvToRgbBand;
+
 /* the capabilities of the inputs and outputs.
  */
 
-#define SINK_CAPS_STR GST_VIDEO_CAPS_MAKE ("I420")
-#define SRC_CAPS_STR GST_VIDEO_CAPS_MAKE ("ARGB")
+#define SINK_CAPS_STR GST_VIDEO_CAPS_MAKE ("{ I420, NV12, NV21, YUY2, UYVY, Y42B, Y444 }")
+#define SRC_CAPS_STR GST_VIDEO_CAPS_MAKE ("{ ARGB, BGRA, RGBA, ABGR, RGB, RGB16 }")
 
 static GstStaticPadTemplate gst_yuvtorgb_sink_template =
 GST_STATIC_PAD_TEMPLATE (
@@ -98,6 +132,7 @@ static void gst_yuv_to_rgb_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec);
 static void gst_yuv_to_rgb_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec);
+static void gst_yuv_to_rgb_finalize (GObject * object);
 
 /* GObject vmethod implementations */
 static GstCaps * gst_yuv_to_rgb_transform_caps (GstBaseTransform * btrans,
@@ -106,6 +141,12 @@ static GstCaps * gst_yuv_to_rgb_transform_caps (GstBaseTransform * btrans,
 static GstCaps * gst_yuv_to_rgb_fixate_caps (GstBaseTransform * trans,
     GstPadDirection direction, GstCaps * caps, GstCaps * othercaps);
 
+static gboolean gst_yuv_to_rgb_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query);
+
+static gboolean gst_yuv_to_rgb_decide_allocation (GstBaseTransform * trans,
+    GstQuery * query);
+
 static gboolean gst_yuv_to_rgb_filter_meta (GstBaseTransform * trans, GstQuery * query,
     GType api, const GstStructure * params);
 
@@ -116,9 +157,14 @@ static gboolean gst_yuv_to_rgb_set_info (GstVideoFilter * filter,
   GstCaps * incaps, GstVideoInfo * in_info, GstCaps * outcaps,
   GstVideoInfo * out_info);
 
+static gboolean gst_yuv_to_rgb_start (GstBaseTransform * trans);
+static gboolean gst_yuv_to_rgb_stop (GstBaseTransform * trans);
+
 static GstFlowReturn gst_yuv_to_rgb_transform_frame (GstVideoFilter *filter,
   GstVideoFrame *in_frame, GstVideoFrame *out_frame);
 
+static void gst_yuv_to_rgb_band_func (gpointer data, gpointer user_data);
+
 
 /* initialize the yuvtorgb's class */
 static void
@@ -131,25 +177,49 @@ gst_yuv_to_rgb_class_init (GstYuvToRgbClass * klass)
 
   gobject_class->set_property = gst_yuv_to_rgb_set_property;
   gobject_class->get_property = gst_yuv_to_rgb_get_property;
+  gobject_class->finalize = gst_yuv_to_rgb_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_N_THREADS,
+      g_param_spec_uint ("n-threads", "Threads",
+          "Number of threads converting row bands of a frame in parallel "
+          "(0 = number of processors)", 0, GST_YUVTORGB_MAX_THREADS,
+          DEFAULT_N_THREADS,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              GST_PARAM_MUTABLE_READY)));
+
+  g_object_class_install_property (gobject_class, PROP_SCALE,
+      g_param_spec_boolean ("scale", "Scale",
+          "Scale I420 input to the output size while converting",
+          DEFAULT_SCALE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+              GST_PARAM_MUTABLE_READY)));
 
   gst_element_class_add_pad_template (gstelement_class,
       gst_static_pad_template_get (&gst_yuvtorgb_src_template));
   gst_element_class_add_pad_template (gstelement_class,
       gst_static_pad_template_get (&gst_yuvtorgb_sink_template));
 
-  gst_element_class_set_static_metadata (gstelement_class, "I420 To RGB16/RGB32",
+  gst_element_class_set_static_metadata (gstelement_class, "YUV To RGB16/RGB32",
     "Filter/Converter/Video",
-    "Converts I420 to RGB16/RGB32 using libyuv",
+    "Converts YUV to RGB16/RGB32 using libyuv",
     "David Chen <david@remotium.com>");
 
   gstbasetransform_class->transform_caps =
       GST_DEBUG_FUNCPTR (gst_yuv_to_rgb_transform_caps);
   gstbasetransform_class->fixate_caps =
       GST_DEBUG_FUNCPTR (gst_yuv_to_rgb_fixate_caps);
+  gstbasetransform_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_yuv_to_rgb_propose_allocation);
+  gstbasetransform_class->decide_allocation =
+      GST_DEBUG_FUNCPTR (gst_yuv_to_rgb_decide_allocation);
   gstbasetransform_class->filter_meta =
       GST_DEBUG_FUNCPTR (gst_yuv_to_rgb_filter_meta);
   gstbasetransform_class->transform_meta =
       GST_DEBUG_FUNCPTR (gst_yuv_to_rgb_transform_meta);
+  gstbasetransform_class->start =
+      GST_DEBUG_FUNCPTR (gst_yuv_to_rgb_start);
+  gstbasetransform_class->stop =
+      GST_DEBUG_FUNCPTR (gst_yuv_to_rgb_stop);
 
   gstbasetransform_class->passthrough_on_same_caps = TRUE;
 
@@ -161,7 +231,7 @@ gst_yuv_to_rgb_class_init (GstYuvToRgbClass * klass)
 
   /* debug category for fltering log messages
    */
-  GST_DEBUG_CATEGORY_INIT (gst_yuv_to_rgb_debug, "yuvtorgb", 0, "Converts I420 to RGB16/RGB32 using libyuv");
+  GST_DEBUG_CATEGORY_INIT (gst_yuv_to_rgb_debug, "yuvtorgb", 0, "Converts YUV to RGB16/RGB32 using libyuv");
 }
 
 /* initialize the new element
@@ -170,67 +240,602 @@ gst_yuv_to_rgb_class_init (GstYuvToRgbClass * klass)
 static void
 gst_yuv_to_rgb_init (GstYuvToRgb *filter)
 {
+  filter->n_threads = DEFAULT_N_THREADS;
+  filter->scale = DEFAULT_SCALE;
+  filter->n_bands = 1;
+  filter->pool = NULL;
+  filter->pending = 0;
+  filter->scratch = NULL;
+  filter->scratch_stride = 0;
+  filter->scratch_band_size = 0;
+  filter->scaling = FALSE;
+  filter->unpack = NULL;
+  filter->pack = NULL;
+
+  g_mutex_init (&filter->lock);
+  g_cond_init (&filter->cond);
+}
+
+static void
+gst_yuv_to_rgb_finalize (GObject * object)
+{
+  GstYuvToRgb *yuvtorgb = GST_YUVTORGB (object);
+
+  g_free (yuvtorgb->scratch);
+  g_mutex_clear (&yuvtorgb->lock);
+  g_cond_clear (&yuvtorgb->cond);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
 static void
 gst_yuv_to_rgb_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec)
 {
+  GstYuvToRgb *yuvtorgb = GST_YUVTORGB (object);
+
+  switch (prop_id) {
+    case PROP_N_THREADS:
+      GST_OBJECT_LOCK (yuvtorgb);
+      yuvtorgb->n_threads = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (yuvtorgb);
+      break;
+    case PROP_SCALE:
+      GST_OBJECT_LOCK (yuvtorgb);
+      yuvtorgb->scale = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (yuvtorgb);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
 }
 
 static void
 gst_yuv_to_rgb_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec)
 {
+  GstYuvToRgb *yuvtorgb = GST_YUVTORGB (object);
+
+  switch (prop_id) {
+    case PROP_N_THREADS:
+      GST_OBJECT_LOCK (yuvtorgb);
+      g_value_set_uint (value, yuvtorgb->n_threads);
+      GST_OBJECT_UNLOCK (yuvtorgb);
+      break;
+    case PROP_SCALE:
+      GST_OBJECT_LOCK (yuvtorgb);
+      g_value_set_boolean (value, yuvtorgb->scale);
+      GST_OBJECT_UNLOCK (yuvtorgb);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+/* spawn the worker threads once, they stay around until stop () so that
+ * no thread is created on the streaming path */
+static gboolean
+gst_yuv_to_rgb_start (GstBaseTransform * trans)
+{
+  GstYuvToRgb *yuvtorgb = GST_YUVTORGB_CAST (trans);
+  GError *err = NULL;
+  guint n_threads;
+
+  GST_OBJECT_LOCK (yuvtorgb);
+  n_threads = yuvtorgb->n_threads;
+  GST_OBJECT_UNLOCK (yuvtorgb);
+
+  if (n_threads == 0)
+    n_threads = MIN (g_get_num_processors (), GST_YUVTORGB_MAX_THREADS);
+
+  yuvtorgb->n_bands = n_threads;
+  yuvtorgb->pending = 0;
+
+  if (n_threads > 1) {
+    /* the streaming thread converts the first band itself */
+    yuvtorgb->pool = g_thread_pool_new (gst_yuv_to_rgb_band_func, yuvtorgb,
+        n_threads - 1, TRUE, &err);
+    if (yuvtorgb->pool == NULL) {
+      GST_WARNING_OBJECT (yuvtorgb, "failed to create worker pool: %s",
+          err->message);
+      g_clear_error (&err);
+      yuvtorgb->n_bands = 1;
+    }
+  }
+
+  GST_DEBUG_OBJECT (yuvtorgb, "converting with %u band(s)", yuvtorgb->n_bands);
+
+  return TRUE;
+}
+
+static gboolean
+gst_yuv_to_rgb_stop (GstBaseTransform * trans)
+{
+  GstYuvToRgb *yuvtorgb = GST_YUVTORGB_CAST (trans);
+
+  if (yuvtorgb->pool) {
+    g_thread_pool_free (yuvtorgb->pool, FALSE, TRUE);
+    yuvtorgb->pool = NULL;
+  }
+  yuvtorgb->n_bands = 1;
+
+  g_free (yuvtorgb->scratch);
+  yuvtorgb->scratch = NULL;
+  yuvtorgb->scratch_stride = 0;
+  yuvtorgb->scratch_band_size = 0;
+
+  return TRUE;
 }
 
 /* GstBaseTransform vmethod implementations */
 
-/* this function does the actual processing
+/* the unpack functions convert rows [y, y + height) of the input with the
+ * kernel chosen in set_info. y is even for the 4:2:0 formats.
  */
-static GstFlowReturn
-gst_yuv_to_rgb_transform_frame (GstVideoFilter *filter, GstVideoFrame *in_frame, GstVideoFrame *out_frame)
+static void
+gst_yuv_to_rgb_unpack_planar (GstYuvToRgb * yuvtorgb, GstVideoFrame * in_frame,
+    gint y, gint height, guint8 * dst, gint dst_stride)
+{
+  gint y_stride, u_stride, v_stride;
+  gint uv_y = y >> yuvtorgb->chroma_shift;
+
+  y_stride = GST_VIDEO_FRAME_PLANE_STRIDE (in_frame, 0);
+  u_stride = GST_VIDEO_FRAME_PLANE_STRIDE (in_frame, yuvtorgb->u_plane);
+  v_stride = GST_VIDEO_FRAME_PLANE_STRIDE (in_frame, yuvtorgb->v_plane);
+
+  yuvtorgb->planar (
+      (guint8*) GST_VIDEO_FRAME_PLANE_DATA (in_frame, 0) + y * y_stride,
+      y_stride,
+      (guint8*) GST_VIDEO_FRAME_PLANE_DATA (in_frame, yuvtorgb->u_plane) +
+      uv_y * u_stride, u_stride,
+      (guint8*) GST_VIDEO_FRAME_PLANE_DATA (in_frame, yuvtorgb->v_plane) +
+      uv_y * v_stride, v_stride,
+      dst, dst_stride, yuvtorgb->constants,
+      GST_VIDEO_FRAME_WIDTH (in_frame), height);
+}
+
+static void
+gst_yuv_to_rgb_unpack_biplanar (GstYuvToRgb * yuvtorgb,
+    GstVideoFrame * in_frame, gint y, gint height, guint8 * dst,
+    gint dst_stride)
 {
-  GstYuvToRgb *rgbtoyuv = GST_YUVTORGB_CAST (filter);
-  gint width, height, stride;
   gint y_stride, uv_stride;
-  guint32 *out_data;
-  guint8 *y_in, *u_in, *v_in;
 
   y_stride = GST_VIDEO_FRAME_PLANE_STRIDE (in_frame, 0);
   uv_stride = GST_VIDEO_FRAME_PLANE_STRIDE (in_frame, 1);
 
-  y_in = (guint8*) GST_VIDEO_FRAME_PLANE_DATA (in_frame, 0);
-  u_in = (guint8*) GST_VIDEO_FRAME_PLANE_DATA (in_frame, 1);
-  v_in = (guint8*) GST_VIDEO_FRAME_PLANE_DATA (in_frame, 2);
+  yuvtorgb->biplanar (
+      (guint8*) GST_VIDEO_FRAME_PLANE_DATA (in_frame, 0) + y * y_stride,
+      y_stride,
+      (guint8*) GST_VIDEO_FRAME_PLANE_DATA (in_frame, 1) +
+      (y >> yuvtorgb->chroma_shift) * uv_stride, uv_stride,
+      dst, dst_stride, yuvtorgb->constants,
+      GST_VIDEO_FRAME_WIDTH (in_frame), height);
+}
+
+static void
+gst_yuv_to_rgb_unpack_packed (GstYuvToRgb * yuvtorgb, GstVideoFrame * in_frame,
+    gint y, gint height, guint8 * dst, gint dst_stride)
+{
+  gint stride = GST_VIDEO_FRAME_PLANE_STRIDE (in_frame, 0);
+
+  yuvtorgb->packed (
+      (guint8*) GST_VIDEO_FRAME_PLANE_DATA (in_frame, 0) + y * stride, stride,
+      dst, dst_stride, yuvtorgb->constants,
+      GST_VIDEO_FRAME_WIDTH (in_frame), height);
+}
+
+/* scales and converts the output rows [band->y, band->y + band->height).
+ * Each strip is scaled together with scale_overlap rows on either side
+ * from the input rows that cover them, so the filter sees the rows next
+ * to the strip and no seams show. Only the strip itself is converted.
+ */
+static void
+gst_yuv_to_rgb_scale_band (GstYuvToRgbBand * band)
+{
+  GstYuvToRgb *yuvtorgb = band->yuvtorgb;
+  GstVideoFrame *in_frame = band->in_frame;
+  GstVideoFrame *out_frame = band->out_frame;
+  gint in_width, in_height, out_width, out_height;
+  gint stride, y_stride, u_stride, v_stride, uv_stride;
+  gint row, rows, y0, y1, src_y0, src_y1, skip, strip_rows;
+  guint8 *strip[3];
+  guint8 *out_data;
+
+  in_width = GST_VIDEO_FRAME_WIDTH (in_frame);
+  in_height = GST_VIDEO_FRAME_HEIGHT (in_frame);
+  out_width = GST_VIDEO_FRAME_WIDTH (out_frame);
+  out_height = GST_VIDEO_FRAME_HEIGHT (out_frame);
+
+  y_stride = GST_VIDEO_FRAME_PLANE_STRIDE (in_frame, 0);
+  u_stride = GST_VIDEO_FRAME_PLANE_STRIDE (in_frame, 1);
+  v_stride = GST_VIDEO_FRAME_PLANE_STRIDE (in_frame, 2);
 
-  width = GST_VIDEO_FRAME_WIDTH (out_frame);
-  height = GST_VIDEO_FRAME_HEIGHT (out_frame);
   stride = GST_VIDEO_FRAME_PLANE_STRIDE (out_frame, 0);
+  out_data = (guint8*) GST_VIDEO_FRAME_PLANE_DATA (out_frame, 0) + band->y * stride;
+
+  /* the scaled strip, laid out as a small I420 frame */
+  uv_stride = yuvtorgb->scale_uv_stride;
+  strip_rows = yuvtorgb->scale_rows + 2 * yuvtorgb->scale_overlap;
+  strip[0] = band->scratch;
+  strip[1] = strip[0] + yuvtorgb->scratch_stride * strip_rows;
+  strip[2] = strip[1] + uv_stride * ((strip_rows + 1) / 2);
+
+  for (row = 0; row < band->height; row += yuvtorgb->scale_rows) {
+    rows = MIN (yuvtorgb->scale_rows, band->height - row);
+
+    /* the output window around the strip and the input rows it maps to,
+     * kept even for the chroma rows */
+    y0 = MAX (band->y + row - yuvtorgb->scale_overlap, 0);
+    y1 = MIN (band->y + row + rows + yuvtorgb->scale_overlap, out_height);
+    src_y0 = GST_ROUND_DOWN_2 (gst_util_uint64_scale_int (y0, in_height,
+            out_height));
+    src_y1 = MIN (GST_ROUND_UP_2 (gst_util_uint64_scale_int_ceil (y1,
+                in_height, out_height)), in_height);
+    skip = band->y + row - y0;
+
+    libyuv::I420Scale (
+        (guint8*) GST_VIDEO_FRAME_PLANE_DATA (in_frame, 0) + src_y0 * y_stride,
+        y_stride,
+        (guint8*) GST_VIDEO_FRAME_PLANE_DATA (in_frame, 1) +
+        (src_y0 >> 1) * u_stride, u_stride,
+        (guint8*) GST_VIDEO_FRAME_PLANE_DATA (in_frame, 2) +
+        (src_y0 >> 1) * v_stride, v_stride,
+        in_width, src_y1 - src_y0,
+        strip[0], yuvtorgb->scratch_stride,
+        strip[1], uv_stride,
+        strip[2], uv_stride,
+        out_width, y1 - y0, yuvtorgb->scale_filter);
+
+    yuvtorgb->planar (strip[0] + skip * yuvtorgb->scratch_stride,
+        yuvtorgb->scratch_stride,
+        strip[yuvtorgb->u_plane] + (skip >> 1) * uv_stride, uv_stride,
+        strip[yuvtorgb->v_plane] + (skip >> 1) * uv_stride, uv_stride,
+        out_data + row * stride, stride, yuvtorgb->constants,
+        out_width, rows);
+  }
+}
 
-  out_data = (guint32*) GST_VIDEO_FRAME_PLANE_DATA (out_frame, 0);
+/* converts the rows [band->y, band->y + band->height) of the frame */
+static void
+gst_yuv_to_rgb_convert_band (GstYuvToRgbBand * band)
+{
+  GstYuvToRgb *yuvtorgb = band->yuvtorgb;
+  GstVideoFrame *out_frame = band->out_frame;
+  gint stride, scratch_stride, row, rows;
+  guint8 *out_data;
+
+  if (yuvtorgb->scaling) {
+    gst_yuv_to_rgb_scale_band (band);
+    return;
+  }
 
-  // GST_INFO ("DEBUG_INFO: rgbtoyuv::transform_frame: ");
-  // GST_INFO ("in stride: %d; out stride: %d %d\n", stride, y_stride, uv_stride);
+  stride = GST_VIDEO_FRAME_PLANE_STRIDE (out_frame, 0);
+  out_data = (guint8*) GST_VIDEO_FRAME_PLANE_DATA (out_frame, 0) + band->y * stride;
 
-  libyuv::I420ToARGB (y_in, y_stride,
-              u_in, uv_stride,
-              v_in, uv_stride,
-              (guint8*)out_data, stride,
-              width, height);
+  if (yuvtorgb->pack == NULL) {
+    yuvtorgb->unpack (yuvtorgb, band->in_frame, band->y, band->height,
+        out_data, stride);
+    return;
+  }
+
+  /* go through a strip of ARGB rows small enough to stay in cache */
+  scratch_stride = yuvtorgb->scratch_stride;
+  for (row = 0; row < band->height; row += GST_YUVTORGB_STRIP_ROWS) {
+    rows = MIN (GST_YUVTORGB_STRIP_ROWS, band->height - row);
+
+    yuvtorgb->unpack (yuvtorgb, band->in_frame, band->y + row, rows,
+        band->scratch, scratch_stride);
+    yuvtorgb->pack (band->scratch, scratch_stride, out_data + row * stride,
+        stride, GST_VIDEO_FRAME_WIDTH (out_frame), rows);
+  }
+}
+
+/* runs in a worker thread of the pool */
+static void
+gst_yuv_to_rgb_band_func (gpointer data, gpointer user_data)
+{
+  GstYuvToRgb *yuvtorgb = GST_YUVTORGB_CAST (user_data);
+
+  gst_yuv_to_rgb_convert_band ((GstYuvToRgbBand *) data);
+
+  g_mutex_lock (&yuvtorgb->lock);
+  if (--yuvtorgb->pending == 0)
+    g_cond_signal (&yuvtorgb->cond);
+  g_mutex_unlock (&yuvtorgb->lock);
+}
+
+/* this function does the actual processing
+ */
+static GstFlowReturn
+gst_yuv_to_rgb_transform_frame (GstVideoFilter *filter, GstVideoFrame *in_frame, GstVideoFrame *out_frame)
+{
+  GstYuvToRgb *yuvtorgb = GST_YUVTORGB_CAST (filter);
+  GstYuvToRgbBand bands[GST_YUVTORGB_MAX_THREADS];
+  gint height, band_height, unit;
+  guint i, n_bands;
+
+  height = GST_VIDEO_FRAME_HEIGHT (out_frame);
+
+  /* split the frame in bands with an even number of rows, or whole scaling
+   * strips, the last band takes whatever is left */
+  n_bands = yuvtorgb->pool ? yuvtorgb->n_bands : 1;
+  unit = yuvtorgb->scaling ? yuvtorgb->scale_rows : 2;
+  band_height = (height + n_bands - 1) / n_bands;
+  band_height = ((band_height + unit - 1) / unit) * unit;
+  if (band_height <= 0)
+    band_height = height;
+
+  for (i = 0; i < n_bands && (gint) (i * band_height) < height; i++) {
+    bands[i].yuvtorgb = yuvtorgb;
+    bands[i].in_frame = in_frame;
+    bands[i].out_frame = out_frame;
+    bands[i].scratch = yuvtorgb->scratch ? yuvtorgb->scratch +
+        i * yuvtorgb->scratch_band_size : NULL;
+    bands[i].y = i * band_height;
+    bands[i].height = MIN (band_height, height - bands[i].y);
+  }
+  n_bands = i;
+
+  if (n_bands > 1) {
+    g_mutex_lock (&yuvtorgb->lock);
+    yuvtorgb->pending = n_bands - 1;
+    g_mutex_unlock (&yuvtorgb->lock);
+
+    for (i = 1; i < n_bands; i++)
+      g_thread_pool_push (yuvtorgb->pool, &bands[i], NULL);
+  }
+
+  gst_yuv_to_rgb_convert_band (&bands[0]);
+
+  if (n_bands > 1) {
+    g_mutex_lock (&yuvtorgb->lock);
+    while (yuvtorgb->pending > 0)
+      g_cond_wait (&yuvtorgb->cond, &yuvtorgb->lock);
+    g_mutex_unlock (&yuvtorgb->lock);
+  }
 
   return GST_FLOW_OK;
 }
 
+/* maps the colorimetry of the input to libyuv's coefficients. The Yvu
+ * tables are for kernels that are fed with U and V swapped, which is how
+ * libyuv produces the byte-swapped RGB orders.
+ */
+static const libyuv::YuvConstants *
+gst_yuv_to_rgb_get_constants (GstYuvToRgb * yuvtorgb,
+    const GstVideoColorimetry * cinfo, gboolean swap_uv)
+{
+  gboolean full_range = (cinfo->range == GST_VIDEO_COLOR_RANGE_0_255);
+
+  switch (cinfo->matrix) {
+    case GST_VIDEO_COLOR_MATRIX_BT709:
+      if (full_range)
+        return swap_uv ? &libyuv::kYvuF709Constants : &libyuv::kYuvF709Constants;
+      return swap_uv ? &libyuv::kYvuH709Constants : &libyuv::kYuvH709Constants;
+#if GST_CHECK_VERSION(1,6,0)
+    case GST_VIDEO_COLOR_MATRIX_BT2020:
+      if (full_range)
+        return swap_uv ? &libyuv::kYvuV2020Constants : &libyuv::kYuvV2020Constants;
+      return swap_uv ? &libyuv::kYvu2020Constants : &libyuv::kYuv2020Constants;
+#endif
+    case GST_VIDEO_COLOR_MATRIX_BT601:
+      break;
+    default:
+      GST_WARNING_OBJECT (yuvtorgb, "no libyuv coefficients for matrix %d, "
+          "using BT.601", cinfo->matrix);
+      break;
+  }
+
+  if (full_range)
+    return swap_uv ? &libyuv::kYvuJPEGConstants : &libyuv::kYuvJPEGConstants;
+  return swap_uv ? &libyuv::kYvuI601Constants : &libyuv::kYuvI601Constants;
+}
+
+/* picks the libyuv kernels for the negotiated formats, so that
+ * transform_frame only calls through the cached pointers.
+ * I420 has a direct kernel for every output. The other inputs produce
+ * libyuv ARGB (GStreamer BGRA), or RGBA by swapping U and V, and are
+ * repacked for the remaining outputs.
+ */
+static gboolean
+gst_yuv_to_rgb_setup_convert (GstYuvToRgb * yuvtorgb, GstVideoInfo * in_info,
+    GstVideoInfo * out_info)
+{
+  GstVideoFormat in_format = GST_VIDEO_INFO_FORMAT (in_info);
+  GstVideoFormat out_format = GST_VIDEO_INFO_FORMAT (out_info);
+  gboolean swap_uv = FALSE;
+
+  yuvtorgb->planar = NULL;
+  yuvtorgb->biplanar = NULL;
+  yuvtorgb->packed = NULL;
+  yuvtorgb->pack = NULL;
+  yuvtorgb->chroma_shift = 0;
+
+  switch (in_format) {
+    case GST_VIDEO_FORMAT_I420:
+      yuvtorgb->chroma_shift = 1;
+      switch (out_format) {
+        case GST_VIDEO_FORMAT_BGRA:
+          yuvtorgb->planar = libyuv::I420ToARGBMatrix;
+          break;
+        case GST_VIDEO_FORMAT_RGBA:
+          yuvtorgb->planar = libyuv::I420ToARGBMatrix;
+          swap_uv = TRUE;
+          break;
+        case GST_VIDEO_FORMAT_ABGR:
+          yuvtorgb->planar = libyuv::I420ToRGBAMatrix;
+          break;
+        case GST_VIDEO_FORMAT_ARGB:
+          yuvtorgb->planar = libyuv::I420ToRGBAMatrix;
+          swap_uv = TRUE;
+          break;
+        case GST_VIDEO_FORMAT_RGB:
+          yuvtorgb->planar = libyuv::I420ToRGB24Matrix;
+          swap_uv = TRUE;
+          break;
+        case GST_VIDEO_FORMAT_RGB16:
+          yuvtorgb->planar = libyuv::I420ToRGB565Matrix;
+          break;
+        default:
+          goto unsupported;
+      }
+      break;
+    case GST_VIDEO_FORMAT_Y42B:
+      yuvtorgb->planar = libyuv::I422ToARGBMatrix;
+      break;
+    case GST_VIDEO_FORMAT_Y444:
+      yuvtorgb->planar = libyuv::I444ToARGBMatrix;
+      break;
+    case GST_VIDEO_FORMAT_NV12:
+      yuvtorgb->biplanar = libyuv::NV12ToARGBMatrix;
+      yuvtorgb->chroma_shift = 1;
+      break;
+    case GST_VIDEO_FORMAT_NV21:
+      yuvtorgb->biplanar = libyuv::NV21ToARGBMatrix;
+      yuvtorgb->chroma_shift = 1;
+      break;
+    case GST_VIDEO_FORMAT_YUY2:
+      yuvtorgb->packed = libyuv::YUY2ToARGBMatrix;
+      break;
+    case GST_VIDEO_FORMAT_UYVY:
+      yuvtorgb->packed = libyuv::UYVYToARGBMatrix;
+      break;
+    default:
+      goto unsupported;
+  }
+
+  if (in_format != GST_VIDEO_FORMAT_I420 && out_format != GST_VIDEO_FORMAT_BGRA) {
+    if (out_format == GST_VIDEO_FORMAT_RGBA && yuvtorgb->planar) {
+      swap_uv = TRUE;
+    } else if (out_format == GST_VIDEO_FORMAT_RGBA && yuvtorgb->biplanar) {
+      /* read the interleaved chroma the other way around */
+      yuvtorgb->biplanar = (in_format == GST_VIDEO_FORMAT_NV12) ?
+          libyuv::NV21ToARGBMatrix : libyuv::NV12ToARGBMatrix;
+      swap_uv = TRUE;
+    } else {
+      switch (out_format) {
+        case GST_VIDEO_FORMAT_RGBA:
+          yuvtorgb->pack = libyuv::ARGBToABGR;
+          break;
+        case GST_VIDEO_FORMAT_ARGB:
+          yuvtorgb->pack = libyuv::ARGBToBGRA;
+          break;
+        case GST_VIDEO_FORMAT_ABGR:
+          yuvtorgb->pack = libyuv::ARGBToRGBA;
+          break;
+        case GST_VIDEO_FORMAT_RGB:
+          yuvtorgb->pack = libyuv::ARGBToRAW;
+          break;
+        case GST_VIDEO_FORMAT_RGB16:
+          yuvtorgb->pack = libyuv::ARGBToRGB565;
+          break;
+        default:
+          goto unsupported;
+      }
+    }
+  }
+
+  if (yuvtorgb->planar)
+    yuvtorgb->unpack = gst_yuv_to_rgb_unpack_planar;
+  else if (yuvtorgb->biplanar)
+    yuvtorgb->unpack = gst_yuv_to_rgb_unpack_biplanar;
+  else
+    yuvtorgb->unpack = gst_yuv_to_rgb_unpack_packed;
+
+  yuvtorgb->u_plane = swap_uv ? 2 : 1;
+  yuvtorgb->v_plane = swap_uv ? 1 : 2;
+  yuvtorgb->constants = gst_yuv_to_rgb_get_constants (yuvtorgb,
+      &GST_VIDEO_INFO_COLORIMETRY (in_info), swap_uv);
+
+  return TRUE;
+
+unsupported:
+  {
+    GST_ERROR_OBJECT (yuvtorgb, "unsupported conversion %s to %s",
+        gst_video_format_to_string (in_format),
+        gst_video_format_to_string (out_format));
+    return FALSE;
+  }
+}
+
+/* sizes the scaling strips. With in_height / out_height = p / q in lowest
+ * terms, q output rows are made from exactly p input rows, so strips of a
+ * multiple of q rows start on an input row and are scaled with the ratio
+ * of the whole frame. Both counts are kept even so the chroma rows line up
+ * too. The bilinear filter also reads the input rows next to a strip, an
+ * overlap of q rows brings them in; the box filter only reads its own.
+ * Ratios with a large q get strips of at most GST_YUVTORGB_SCALE_MAX_ROWS
+ * rows, whose input windows are rounded to even rows, and an overlap that
+ * covers a couple of input rows.
+ */
+static void
+gst_yuv_to_rgb_setup_scale (GstYuvToRgb * yuvtorgb, GstVideoInfo * in_info,
+    GstVideoInfo * out_info)
+{
+  gint a, b, t, p, q, rows, overlap, strip_rows;
+
+  /* box is both faster and sharper for large downscales */
+  if (in_info->width >= 2 * out_info->width &&
+      in_info->height >= 2 * out_info->height)
+    yuvtorgb->scale_filter = libyuv::kFilterBox;
+  else
+    yuvtorgb->scale_filter = libyuv::kFilterBilinear;
+
+  a = in_info->height;
+  b = out_info->height;
+  while (b != 0) {
+    t = a % b;
+    a = b;
+    b = t;
+  }
+  p = in_info->height / a;
+  q = out_info->height / a;
+
+  if ((p | q) & 1) {
+    p *= 2;
+    q *= 2;
+  }
+
+  if (q <= GST_YUVTORGB_SCALE_MAX_ROWS) {
+    overlap = yuvtorgb->scale_filter == libyuv::kFilterBox ? 0 : q;
+    rows = q;
+    while (rows < GST_YUVTORGB_SCALE_MIN_ROWS &&
+        rows * 2 <= GST_YUVTORGB_SCALE_MAX_ROWS)
+      rows *= 2;
+  } else {
+    GST_DEBUG_OBJECT (yuvtorgb, "no aligned strip for %d -> %d rows",
+        in_info->height, out_info->height);
+    overlap = GST_ROUND_UP_2 (2 + gst_util_uint64_scale_int_ceil (2,
+            out_info->height, in_info->height));
+    rows = GST_YUVTORGB_SCALE_MAX_ROWS;
+  }
+
+  yuvtorgb->scale_rows = rows;
+  yuvtorgb->scale_overlap = overlap;
+  strip_rows = rows + 2 * overlap;
+
+  yuvtorgb->scratch_stride = GST_ROUND_UP_32 (out_info->width);
+  yuvtorgb->scale_uv_stride = GST_ROUND_UP_32 ((out_info->width + 1) / 2);
+  yuvtorgb->scratch_band_size = yuvtorgb->scratch_stride * strip_rows +
+      2 * yuvtorgb->scale_uv_stride * ((strip_rows + 1) / 2);
+
+  GST_DEBUG_OBJECT (yuvtorgb, "scaling %dx%d -> %dx%d in strips of %d rows "
+      "with %d rows of overlap", in_info->width, in_info->height,
+      out_info->width, out_info->height, rows, overlap);
+}
+
 static gboolean
 gst_yuv_to_rgb_set_info (GstVideoFilter * filter,
   GstCaps * incaps, GstVideoInfo * in_info, GstCaps * outcaps,
   GstVideoInfo * out_info)
 {
   GstYuvToRgb *yuvtorgb = GST_YUVTORGB_CAST (filter);
+  gboolean scale;
 
-  if (in_info->width != out_info->width || in_info->height != out_info->height
-      || in_info->fps_n != out_info->fps_n || in_info->fps_d != out_info->fps_d)
+  if (in_info->fps_n != out_info->fps_n || in_info->fps_d != out_info->fps_d)
     goto format_mismatch;
 
   /* if present, these must match too */
@@ -241,6 +846,38 @@ gst_yuv_to_rgb_set_info (GstVideoFilter * filter,
   if (in_info->interlace_mode != out_info->interlace_mode)
     goto format_mismatch;
 
+  GST_OBJECT_LOCK (yuvtorgb);
+  scale = yuvtorgb->scale;
+  GST_OBJECT_UNLOCK (yuvtorgb);
+
+  yuvtorgb->scaling = (in_info->width != out_info->width ||
+      in_info->height != out_info->height);
+  if (yuvtorgb->scaling && (!scale ||
+          GST_VIDEO_INFO_FORMAT (in_info) != GST_VIDEO_FORMAT_I420))
+    goto format_mismatch;
+
+  if (!gst_yuv_to_rgb_setup_convert (yuvtorgb, in_info, out_info))
+    return FALSE;
+
+  g_free (yuvtorgb->scratch);
+  yuvtorgb->scratch = NULL;
+  yuvtorgb->scratch_stride = 0;
+  yuvtorgb->scratch_band_size = 0;
+
+  if (yuvtorgb->scaling) {
+    gst_yuv_to_rgb_setup_scale (yuvtorgb, in_info, out_info);
+  } else if (yuvtorgb->pack != NULL) {
+    /* a strip of ARGB rows per band for the formats without a direct
+     * kernel */
+    yuvtorgb->scratch_stride = GST_ROUND_UP_64 (out_info->width * 4);
+    yuvtorgb->scratch_band_size =
+        yuvtorgb->scratch_stride * GST_YUVTORGB_STRIP_ROWS;
+  }
+
+  if (yuvtorgb->scratch_band_size > 0)
+    yuvtorgb->scratch = (guint8 *) g_malloc (yuvtorgb->scratch_band_size *
+        MAX (yuvtorgb->n_bands, 1));
+
   GST_DEBUG ("reconfigured %d %d", GST_VIDEO_INFO_FORMAT (in_info),
       GST_VIDEO_INFO_FORMAT (out_info));
 
@@ -254,13 +891,32 @@ format_mismatch:
   }
 }
 
-/* copies the given caps */
+/* only I420 input is scaled */
+static gboolean
+gst_yuv_to_rgb_structure_can_scale (GstStructure * st)
+{
+  GstStructure *i420;
+  gboolean ret;
+
+  i420 = gst_structure_new ("video/x-raw", "format", G_TYPE_STRING, "I420",
+      NULL);
+  ret = gst_structure_can_intersect (st, i420);
+  gst_structure_free (i420);
+
+  return ret;
+}
+
+/* copies the given caps, with any size when scaling is possible. From the
+ * output side other sizes are only offered for I420 input.
+ */
 static GstCaps *
-gst_yuv_to_rgb_caps_remove_format_info (GstCaps * caps)
+gst_yuv_to_rgb_caps_remove_format_info (GstCaps * caps,
+    GstPadDirection direction, gboolean scale)
 {
-  GstStructure *st;
+  GstStructure *st, *scaled;
   gint i, n;
   GstCaps *res;
+  gboolean any_size;
 
   res = gst_caps_new_empty ();
 
@@ -273,11 +929,31 @@ gst_yuv_to_rgb_caps_remove_format_info (GstCaps * caps)
     if (i > 0 && gst_caps_is_subset_structure (res, st))
       continue;
 
+    any_size = scale && direction == GST_PAD_SINK &&
+        gst_yuv_to_rgb_structure_can_scale (st);
+
     st = gst_structure_copy (st);
     gst_structure_remove_fields (st, "format",
         "colorimetry", "chroma-site", NULL);
 
-    gst_caps_append_structure (res, st);
+    /* the same size in any format first, then I420 at any size */
+    scaled = NULL;
+    if (scale && direction == GST_PAD_SRC) {
+      scaled = gst_structure_copy (st);
+      gst_structure_set (scaled, "format", G_TYPE_STRING, "I420", NULL);
+    } else if (any_size) {
+      scaled = st;
+      st = NULL;
+    }
+    if (scaled)
+      gst_structure_set (scaled,
+          "width", GST_TYPE_INT_RANGE, 1, G_MAXINT,
+          "height", GST_TYPE_INT_RANGE, 1, G_MAXINT, NULL);
+
+    if (st)
+      gst_caps_append_structure (res, st);
+    if (scaled)
+      gst_caps_append_structure (res, scaled);
   }
 
   return res;
@@ -293,9 +969,14 @@ gst_yuv_to_rgb_transform_caps (GstBaseTransform * btrans,
   GstYuvToRgb *yuvtorgb = GST_YUVTORGB_CAST (btrans);
   GstCaps *tmp, *tmp2;
   GstCaps *result;
+  gboolean scale;
+
+  GST_OBJECT_LOCK (yuvtorgb);
+  scale = yuvtorgb->scale;
+  GST_OBJECT_UNLOCK (yuvtorgb);
 
   /* Get all possible caps that we can transform to */
-  tmp = gst_yuv_to_rgb_caps_remove_format_info (caps);
+  tmp = gst_yuv_to_rgb_caps_remove_format_info (caps, direction, scale);
 
   if (filter) {
     tmp2 = gst_caps_intersect_full (filter, tmp, GST_CAPS_INTERSECT_FIRST);
@@ -311,6 +992,42 @@ gst_yuv_to_rgb_transform_caps (GstBaseTransform * btrans,
   return result;
 }
 
+/* fixates an open output size from the input size, keeping the input
+ * aspect ratio when downstream only gives one of width or height */
+static GstCaps *
+gst_yuv_to_rgb_fixate_size (GstCaps * caps, GstCaps * result)
+{
+  GstStructure *in_s, *s;
+  gint in_width, in_height, width, height;
+
+  if (gst_caps_is_empty (result))
+    return result;
+
+  in_s = gst_caps_get_structure (caps, 0);
+  if (!gst_structure_get_int (in_s, "width", &in_width) ||
+      !gst_structure_get_int (in_s, "height", &in_height))
+    return result;
+
+  result = gst_caps_truncate (result);
+  result = gst_caps_make_writable (result);
+  s = gst_caps_get_structure (result, 0);
+
+  if (gst_structure_get_int (s, "width", &width)) {
+    gst_structure_fixate_field_nearest_int (s, "height",
+        GST_ROUND_UP_2 (gst_util_uint64_scale_int (width, in_height,
+                in_width)));
+  } else if (gst_structure_get_int (s, "height", &height)) {
+    gst_structure_fixate_field_nearest_int (s, "width",
+        GST_ROUND_UP_2 (gst_util_uint64_scale_int (height, in_width,
+                in_height)));
+  } else {
+    gst_structure_fixate_field_nearest_int (s, "width", in_width);
+    gst_structure_fixate_field_nearest_int (s, "height", in_height);
+  }
+
+  return result;
+}
+
 static GstCaps *
 gst_yuv_to_rgb_fixate_caps (GstBaseTransform * trans,
     GstPadDirection direction, GstCaps * caps, GstCaps * othercaps)
@@ -327,12 +1044,42 @@ gst_yuv_to_rgb_fixate_caps (GstBaseTransform * trans,
     gst_caps_unref (othercaps);
   }
 
+  /* when scaling, stay as close to the input size as downstream allows */
+  if (direction == GST_PAD_SINK)
+    result = gst_yuv_to_rgb_fixate_size (caps, result);
+
   /* fixate remaining fields */
   result = gst_caps_fixate (result);
 
   return result;
 }
 
+/* offer upstream a pool with padded strides for our input */
+static gboolean
+gst_yuv_to_rgb_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query)
+{
+  if (!GST_BASE_TRANSFORM_CLASS (parent_class)->propose_allocation (trans,
+          decide_query, query))
+    return FALSE;
+
+  /* in passthrough upstream allocates for downstream */
+  if (gst_base_transform_is_passthrough (trans))
+    return TRUE;
+
+  return gst_libyuv_propose_allocation (GST_OBJECT_CAST (trans), query);
+}
+
+static gboolean
+gst_yuv_to_rgb_decide_allocation (GstBaseTransform * trans, GstQuery * query)
+{
+  if (!gst_libyuv_decide_allocation (GST_OBJECT_CAST (trans), query))
+    return FALSE;
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->decide_allocation (trans,
+      query);
+}
+
 static gboolean
 gst_yuv_to_rgb_filter_meta (GstBaseTransform * trans, GstQuery * query,
     GType api, const GstStructure * params)
@@ -368,7 +1115,7 @@ static gboolean
 plugin_init (GstPlugin * plugin)
 {
  /* initialize gst controller library */
- GST_DEBUG_CATEGORY_INIT (gst_yuv_to_rgb_debug, "rgbtoyuv", 0, "Converts I420 to ARGB using libyuv");
+ GST_DEBUG_CATEGORY_INIT (gst_yuv_to_rgb_debug, "rgbtoyuv", 0, "Converts YUV to RGB using libyuv");
 
  return gst_element_register (plugin, "yuvtorgb", GST_RANK_NONE,
      GST_TYPE_YUVTORGB);
@@ -380,7 +1127,7 @@ GST_PLUGIN_DEFINE (
     GST_VERSION_MAJOR,
     GST_VERSION_MINOR,
     yuvtorgb,
-    "Converts I420 to ARGB using libyuv",
+    "Converts YUV to RGB using libyuv",
     plugin_init,
     VERSION,
     "LGPL",
@@ -26,6 +26,9 @@
 #include <gst/video/video.h>
 #include <gst/video/gstvideofilter.h>
 
+/* include libyuv */
+#include "libyuv.h"
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_YUVTORGB \
@@ -45,8 +48,61 @@ G_BEGIN_DECLS
 typedef struct _GstYuvToRgb      GstYuvToRgb;
 typedef struct _GstYuvToRgbClass GstYuvToRgbClass;
 
+/* libyuv kernels, picked in set_info () from the negotiated formats */
+typedef int (*GstYuvToRgbPlanarFunc) (const guint8 * src_y, int src_stride_y,
+    const guint8 * src_u, int src_stride_u, const guint8 * src_v,
+    int src_stride_v, guint8 * dst, int dst_stride,
+    const libyuv::YuvConstants * constants, int width, int height);
+typedef int (*GstYuvToRgbBiplanarFunc) (const guint8 * src_y,
+    int src_stride_y, const guint8 * src_uv, int src_stride_uv, guint8 * dst,
+    int dst_stride, const libyuv::YuvConstants * constants, int width,
+    int height);
+typedef int (*GstYuvToRgbPackedFunc) (const guint8 * src, int src_stride,
+    guint8 * dst, int dst_stride, const libyuv::YuvConstants * constants,
+    int width, int height);
+typedef int (*GstYuvToRgbPackFunc) (const guint8 * src, int src_stride,
+    guint8 * dst, int dst_stride, int width, int height);
+
+typedef void (*GstYuvToRgbUnpackFunc) (GstYuvToRgb * yuvtorgb,
+    GstVideoFrame * in_frame, gint y, gint height, guint8 * dst,
+    gint dst_stride);
+
 struct _GstYuvToRgb {
   GstVideoFilter element;
+
+  guint n_threads;            /* requested number of worker threads, 0 = auto */
+  gboolean scale;             /* allow an output size different from the input */
+
+  /* slice-parallel conversion, set up in start () */
+  guint n_bands;              /* row bands per frame */
+  GThreadPool *pool;          /* persistent workers for bands 1..n_bands-1 */
+  GMutex lock;
+  GCond cond;
+  guint pending;              /* bands not converted yet, protected by lock */
+
+  /* ARGB rows for inputs without a direct kernel to the output format,
+   * one strip of GST_YUVTORGB_STRIP_ROWS rows per band, or a strip of
+   * scaled I420 rows per band when scaling */
+  guint8 *scratch;
+  gint scratch_stride;
+  gsize scratch_band_size;
+
+  /* fused scaling, the output is produced in strips of scale_rows rows,
+   * each scaled with scale_overlap extra rows above and below */
+  gboolean scaling;
+  gint scale_rows, scale_overlap;
+  gint scale_uv_stride;
+  libyuv::FilterMode scale_filter;
+
+  /* conversion chosen once at negotiation */
+  GstYuvToRgbUnpackFunc unpack;     /* YUV rows to output or libyuv ARGB */
+  GstYuvToRgbPlanarFunc planar;
+  GstYuvToRgbBiplanarFunc biplanar;
+  GstYuvToRgbPackedFunc packed;
+  GstYuvToRgbPackFunc pack;         /* libyuv ARGB to output, NULL if direct */
+  const libyuv::YuvConstants *constants;
+  guint u_plane, v_plane;
+  gint chroma_shift;                /* vertical chroma subsampling */
 };
 
 struct _GstYuvToRgbClass {
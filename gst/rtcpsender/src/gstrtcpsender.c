@@ -53,10 +53,39 @@
 
 #include <gst/gst.h>
 #include <gst/rtp/gstrtcpbuffer.h>
+#include <gst/rtp/gstrtpbuffer.h>
 #include "gstrtcpsender.h"
 
 #define RTCP_MTU_SIZE 1200
 
+/* RFC 3550 A.1 */
+#define RTP_SEQ_MOD (1 << 16)
+#define MAX_DROPOUT 3000
+#define MAX_MISORDER 100
+#define MIN_SEQUENTIAL 2
+
+/* RFC 3550 6.3 */
+#define RTCP_MIN_INTERVAL 5.0
+#define RTCP_COMPENSATION (2.71828 - 1.5)
+#define UDP_IP_HEADER_SIZE 28
+/* a receiver report with one block */
+#define RTCP_INITIAL_SIZE (UDP_IP_HEADER_SIZE + 8 + 24)
+/* RFC 3550 6.3.5, sources silent for 5 minimum intervals are gone */
+#define RTCP_SOURCE_TIMEOUT (5 * RTCP_MIN_INTERVAL * G_USEC_PER_SEC)
+#define RTCP_MAX_REPORT_BLOCKS 31
+
+#define DEFAULT_BANDWIDTH 64000
+#define DEFAULT_RTCP_FRACTION 0.05
+#define DEFAULT_REDUCED_MINIMUM FALSE
+#define DEFAULT_COALESCE_WINDOW 0
+
+/* buffers kept around by the pool */
+#define RTCP_POOL_MIN_BUFFERS 4
+
+#if !GLIB_CHECK_VERSION(2,68,0)
+#define g_memdup2(mem,size) g_memdup ((mem), (size))
+#endif
+
 
 /* the capabilities of the inputs and outputs.
  *
@@ -69,17 +98,44 @@ static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
     GST_STATIC_CAPS ("application/x-rtcp")
     );
 
+/* one src pad per further RTCP session, the number is the session id */
+static GstStaticPadTemplate src_session_factory = GST_STATIC_PAD_TEMPLATE ("src_%u",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS ("application/x-rtcp")
+    );
+
+/* RTP to report on in the session of the same number, and the RTCP with
+ * its sender reports when muxed */
+static GstStaticPadTemplate rtp_sink_factory = GST_STATIC_PAD_TEMPLATE ("rtp_sink_%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS ("application/x-rtp; application/x-rtcp")
+    );
+
 /* Filter signals and args */
 enum
 {
   /* FILL ME */
   SIGNAL_SEND_RTCP,
+  SIGNAL_SEND_PLI,
+  SIGNAL_SEND_FIR,
+  SIGNAL_SEND_NACK,
+  SIGNAL_SEND_REMB,
+  SIGNAL_ADD_SSRC,
+  SIGNAL_REMOVE_SSRC,
+  SIGNAL_ADD_SESSION_SSRC,
+  SIGNAL_SEND_SESSION_RTCP,
   LAST_SIGNAL
 };
 
 enum
 {
-  PROP_0
+  PROP_0,
+  PROP_BANDWIDTH,
+  PROP_RTCP_FRACTION,
+  PROP_REDUCED_MINIMUM,
+  PROP_COALESCE_WINDOW
 };
 
 GST_DEBUG_CATEGORY_STATIC (gst_rtcpsender_debug);
@@ -89,7 +145,40 @@ GST_DEBUG_CATEGORY_STATIC (gst_rtcpsender_debug);
 G_DEFINE_TYPE (GstRtcpSender, gst_rtcpsender, GST_TYPE_ELEMENT);
 
 static GstFlowReturn gst_rtcpsender_src_event (GstPad * pad, GstObject * parent, GstEvent *event);
+static void gst_rtcpsender_finalize (GObject * object);
+static void gst_rtcpsender_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_rtcpsender_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static GstStateChangeReturn gst_rtcpsender_change_state (GstElement * element,
+    GstStateChange transition);
+static GHashTable *gst_rtcpsender_new_pending (void);
+static void gst_rtcpsender_schedule (GstRtcpSender * rtcpsender);
+static GstPad *gst_rtcpsender_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+static void gst_rtcpsender_release_pad (GstElement * element, GstPad * pad);
+static GstFlowReturn gst_rtcpsender_rtp_chain (GstPad * pad,
+    GstObject * parent, GstBuffer * buf);
+static gboolean gst_rtcpsender_rtp_event (GstPad * pad, GstObject * parent,
+    GstEvent * event);
 static GstFlowReturn gst_rtcpsender_send_rtcp (GstRtcpSender * rtcpsender, guint32 ssrc);
+static GstFlowReturn gst_rtcpsender_send_pli (GstRtcpSender * rtcpsender,
+    guint32 ssrc, guint32 media_ssrc);
+static GstFlowReturn gst_rtcpsender_send_fir (GstRtcpSender * rtcpsender,
+    guint32 ssrc, guint32 media_ssrc);
+static GstFlowReturn gst_rtcpsender_send_nack (GstRtcpSender * rtcpsender,
+    guint32 ssrc, guint32 media_ssrc, GArray * seqnums);
+static GstFlowReturn gst_rtcpsender_send_remb (GstRtcpSender * rtcpsender,
+    guint32 ssrc, guint64 bitrate, GArray * ssrcs);
+static void gst_rtcpsender_add_ssrc (GstRtcpSender * rtcpsender,
+    guint32 ssrc);
+static void gst_rtcpsender_remove_ssrc (GstRtcpSender * rtcpsender,
+    guint32 ssrc);
+static void gst_rtcpsender_add_session_ssrc (GstRtcpSender * rtcpsender,
+    guint session, guint32 ssrc);
+static GstFlowReturn gst_rtcpsender_send_session_rtcp (GstRtcpSender *
+    rtcpsender, guint session, guint32 ssrc);
+static void gst_rtcpsender_report_loop (GstRtcpSender * rtcpsender);
 
 static guint gst_rtcpsender_signals[LAST_SIGNAL] = { 0 };
 
@@ -103,8 +192,20 @@ gst_rtcpsender_class_init (GstRtcpSenderClass * klass)
   gobject_class     = (GObjectClass *) klass;
   gstelement_class  = (GstElementClass *) klass;
 
+  gobject_class->finalize = gst_rtcpsender_finalize;
+  gobject_class->set_property = gst_rtcpsender_set_property;
+  gobject_class->get_property = gst_rtcpsender_get_property;
+
+  gstelement_class->change_state = gst_rtcpsender_change_state;
+  gstelement_class->request_new_pad = gst_rtcpsender_request_new_pad;
+  gstelement_class->release_pad = gst_rtcpsender_release_pad;
+
   gst_element_class_add_pad_template (gstelement_class,
       gst_static_pad_template_get (&src_factory));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&src_session_factory));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&rtp_sink_factory));
 
   gst_rtcpsender_signals[SIGNAL_SEND_RTCP] =
       g_signal_new ("send-rtcp", G_TYPE_FROM_CLASS (klass),
@@ -112,16 +213,114 @@ gst_rtcpsender_class_init (GstRtcpSenderClass * klass)
           send_rtcp), NULL, NULL, g_cclosure_marshal_VOID__UINT,
       GST_TYPE_FLOW_RETURN, 1, G_TYPE_UINT);
 
+  /* feedback messages, sent after a receiver report from ssrc */
+  gst_rtcpsender_signals[SIGNAL_SEND_PLI] =
+      g_signal_new ("send-pli", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION, G_STRUCT_OFFSET (GstRtcpSenderClass,
+          send_pli), NULL, NULL, NULL,
+      GST_TYPE_FLOW_RETURN, 2, G_TYPE_UINT, G_TYPE_UINT);
+  gst_rtcpsender_signals[SIGNAL_SEND_FIR] =
+      g_signal_new ("send-fir", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION, G_STRUCT_OFFSET (GstRtcpSenderClass,
+          send_fir), NULL, NULL, NULL,
+      GST_TYPE_FLOW_RETURN, 2, G_TYPE_UINT, G_TYPE_UINT);
+  /* seqnums is a GArray of guint, the lost sequence numbers in order */
+  gst_rtcpsender_signals[SIGNAL_SEND_NACK] =
+      g_signal_new ("send-nack", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION, G_STRUCT_OFFSET (GstRtcpSenderClass,
+          send_nack), NULL, NULL, NULL,
+      GST_TYPE_FLOW_RETURN, 3, G_TYPE_UINT, G_TYPE_UINT, G_TYPE_ARRAY);
+  /* bitrate in bits per second, ssrcs is a GArray of the guint media
+   * ssrcs it applies to */
+  gst_rtcpsender_signals[SIGNAL_SEND_REMB] =
+      g_signal_new ("send-remb", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION, G_STRUCT_OFFSET (GstRtcpSenderClass,
+          send_remb), NULL, NULL, NULL,
+      GST_TYPE_FLOW_RETURN, 3, G_TYPE_UINT, G_TYPE_UINT64, G_TYPE_ARRAY);
+
+  /* local ssrcs sending receiver reports on their own while PLAYING */
+  gst_rtcpsender_signals[SIGNAL_ADD_SSRC] =
+      g_signal_new ("add-ssrc", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION, G_STRUCT_OFFSET (GstRtcpSenderClass,
+          add_ssrc), NULL, NULL, g_cclosure_marshal_VOID__UINT,
+      G_TYPE_NONE, 1, G_TYPE_UINT);
+  gst_rtcpsender_signals[SIGNAL_REMOVE_SSRC] =
+      g_signal_new ("remove-ssrc", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION, G_STRUCT_OFFSET (GstRtcpSenderClass,
+          remove_ssrc), NULL, NULL, g_cclosure_marshal_VOID__UINT,
+      G_TYPE_NONE, 1, G_TYPE_UINT);
+
+  /* as add-ssrc and send-rtcp, in the session of the src_%u pad with that
+   * number. Feedback from an ssrc added to a session goes there too. */
+  gst_rtcpsender_signals[SIGNAL_ADD_SESSION_SSRC] =
+      g_signal_new ("add-session-ssrc", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION, G_STRUCT_OFFSET (GstRtcpSenderClass,
+          add_session_ssrc), NULL, NULL, NULL,
+      G_TYPE_NONE, 2, G_TYPE_UINT, G_TYPE_UINT);
+  gst_rtcpsender_signals[SIGNAL_SEND_SESSION_RTCP] =
+      g_signal_new ("send-session-rtcp", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION, G_STRUCT_OFFSET (GstRtcpSenderClass,
+          send_session_rtcp), NULL, NULL, NULL,
+      GST_TYPE_FLOW_RETURN, 2, G_TYPE_UINT, G_TYPE_UINT);
+
+  g_object_class_install_property (gobject_class, PROP_BANDWIDTH,
+      g_param_spec_uint ("bandwidth", "Bandwidth",
+          "Session bandwidth in bits per second, for the report interval",
+          0, G_MAXUINT, DEFAULT_BANDWIDTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_RTCP_FRACTION,
+      g_param_spec_double ("rtcp-fraction", "RTCP fraction",
+          "Fraction of the session bandwidth used by RTCP", 0.0, 1.0,
+          DEFAULT_RTCP_FRACTION, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_REDUCED_MINIMUM,
+      g_param_spec_boolean ("reduced-minimum", "Reduced minimum",
+          "Use the reduced minimum interval of 360 / bandwidth in kbps "
+          "seconds instead of 5 seconds", DEFAULT_REDUCED_MINIMUM,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_COALESCE_WINDOW,
+      g_param_spec_uint ("coalesce-window", "Coalesce window",
+          "Milliseconds feedback messages are held to be sent together in "
+          "one compound packet (0 = send each at once)", 0, 1000,
+          DEFAULT_COALESCE_WINDOW, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gst_element_class_set_static_metadata (gstelement_class, "Rtcp Sender",
     "Network/RTCP",
     "Send custom RTCP packets when triggered",
     "David Chen <david@remotium.com>");
 
   klass->send_rtcp = gst_rtcpsender_send_rtcp;
+  klass->send_pli = gst_rtcpsender_send_pli;
+  klass->send_fir = gst_rtcpsender_send_fir;
+  klass->send_nack = gst_rtcpsender_send_nack;
+  klass->send_remb = gst_rtcpsender_send_remb;
+  klass->add_ssrc = gst_rtcpsender_add_ssrc;
+  klass->remove_ssrc = gst_rtcpsender_remove_ssrc;
+  klass->add_session_ssrc = gst_rtcpsender_add_session_ssrc;
+  klass->send_session_rtcp = gst_rtcpsender_send_session_rtcp;
 
   GST_DEBUG_CATEGORY_INIT (gst_rtcpsender_debug, "rtcpsender", 0, "RTCP Sender");
 }
 
+static GstRtcpSenderSession *
+gst_rtcpsender_session_new (guint id)
+{
+  GstRtcpSenderSession *session;
+
+  session = g_new0 (GstRtcpSenderSession, 1);
+  session->id = id;
+  session->sources = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+  session->avg_rtcp_size = RTCP_INITIAL_SIZE;
+
+  return session;
+}
+
+static void
+gst_rtcpsender_session_free (GstRtcpSenderSession * session)
+{
+  g_hash_table_destroy (session->sources);
+  g_free (session);
+}
+
 /* initialize the new element
  * instantiate pads and add them to element
  * set pad calback functions
@@ -130,6 +329,9 @@ gst_rtcpsender_class_init (GstRtcpSenderClass * klass)
 static void
 gst_rtcpsender_init (GstRtcpSender * filter)
 {
+  GstRtcpSenderSession *session;
+  GstStructure *config;
+
   filter->srcpad = gst_pad_new_from_static_template (&src_factory, "src");
   GST_PAD_SET_PROXY_CAPS (filter->srcpad);
 
@@ -137,7 +339,123 @@ gst_rtcpsender_init (GstRtcpSender * filter)
 
   gst_element_add_pad (GST_ELEMENT (filter), filter->srcpad);
 
-  filter->started = FALSE;
+  session = gst_rtcpsender_session_new (0);
+  session->srcpad = filter->srcpad;
+  filter->sessions = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) gst_rtcpsender_session_free);
+  g_hash_table_insert (filter->sessions, GUINT_TO_POINTER (0), session);
+  filter->next_session = 1;
+
+  filter->fir_seqnums = g_hash_table_new (NULL, NULL);
+
+  filter->bandwidth = DEFAULT_BANDWIDTH;
+  filter->rtcp_fraction = DEFAULT_RTCP_FRACTION;
+  filter->reduced_minimum = DEFAULT_REDUCED_MINIMUM;
+  filter->locals = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+
+  filter->due = g_array_new (FALSE, FALSE, sizeof (guint32));
+  g_cond_init (&filter->due_cond);
+  g_rec_mutex_init (&filter->task_lock);
+  filter->task = gst_task_new ((GstTaskFunction) gst_rtcpsender_report_loop,
+      filter, NULL);
+  gst_task_set_lock (filter->task, &filter->task_lock);
+
+  filter->coalesce_window = DEFAULT_COALESCE_WINDOW;
+  filter->pending = gst_rtcpsender_new_pending ();
+
+  filter->pool = gst_buffer_pool_new ();
+  config = gst_buffer_pool_get_config (filter->pool);
+  gst_buffer_pool_config_set_params (config, NULL, RTCP_MTU_SIZE,
+      RTCP_POOL_MIN_BUFFERS, 0);
+  gst_buffer_pool_set_config (filter->pool, config);
+  gst_buffer_pool_set_active (filter->pool, TRUE);
+}
+
+static void
+gst_rtcpsender_finalize (GObject * object)
+{
+  GstRtcpSender *rtcpsender = GST_RTCPSENDER (object);
+
+  g_hash_table_destroy (rtcpsender->fir_seqnums);
+  g_hash_table_destroy (rtcpsender->locals);
+  g_hash_table_destroy (rtcpsender->sessions);
+  g_hash_table_destroy (rtcpsender->pending);
+
+  gst_object_unref (rtcpsender->task);
+  g_rec_mutex_clear (&rtcpsender->task_lock);
+  g_cond_clear (&rtcpsender->due_cond);
+  g_array_free (rtcpsender->due, TRUE);
+
+  gst_buffer_pool_set_active (rtcpsender->pool, FALSE);
+  gst_object_unref (rtcpsender->pool);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_rtcpsender_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstRtcpSender *rtcpsender = GST_RTCPSENDER (object);
+
+  switch (prop_id) {
+    case PROP_BANDWIDTH:
+      GST_OBJECT_LOCK (rtcpsender);
+      rtcpsender->bandwidth = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (rtcpsender);
+      break;
+    case PROP_RTCP_FRACTION:
+      GST_OBJECT_LOCK (rtcpsender);
+      rtcpsender->rtcp_fraction = g_value_get_double (value);
+      GST_OBJECT_UNLOCK (rtcpsender);
+      break;
+    case PROP_REDUCED_MINIMUM:
+      GST_OBJECT_LOCK (rtcpsender);
+      rtcpsender->reduced_minimum = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (rtcpsender);
+      break;
+    case PROP_COALESCE_WINDOW:
+      GST_OBJECT_LOCK (rtcpsender);
+      rtcpsender->coalesce_window = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (rtcpsender);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_rtcpsender_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstRtcpSender *rtcpsender = GST_RTCPSENDER (object);
+
+  switch (prop_id) {
+    case PROP_BANDWIDTH:
+      GST_OBJECT_LOCK (rtcpsender);
+      g_value_set_uint (value, rtcpsender->bandwidth);
+      GST_OBJECT_UNLOCK (rtcpsender);
+      break;
+    case PROP_RTCP_FRACTION:
+      GST_OBJECT_LOCK (rtcpsender);
+      g_value_set_double (value, rtcpsender->rtcp_fraction);
+      GST_OBJECT_UNLOCK (rtcpsender);
+      break;
+    case PROP_REDUCED_MINIMUM:
+      GST_OBJECT_LOCK (rtcpsender);
+      g_value_set_boolean (value, rtcpsender->reduced_minimum);
+      GST_OBJECT_UNLOCK (rtcpsender);
+      break;
+    case PROP_COALESCE_WINDOW:
+      GST_OBJECT_LOCK (rtcpsender);
+      g_value_set_uint (value, rtcpsender->coalesce_window);
+      GST_OBJECT_UNLOCK (rtcpsender);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
 }
 
 static GstFlowReturn
@@ -147,48 +465,1300 @@ gst_rtcpsender_src_event (GstPad * pad, GstObject * parent, GstEvent *event)
   return gst_pad_event_default (pad, parent, event);
 }
 
-/* chain function
- * this function does the actual processing
- */
+/* called with the object lock */
+static GstRtcpSenderSession *
+gst_rtcpsender_get_session (GstRtcpSender * rtcpsender, guint id)
+{
+  GstRtcpSenderSession *session;
+
+  session = g_hash_table_lookup (rtcpsender->sessions, GUINT_TO_POINTER (id));
+  if (session == NULL) {
+    GST_DEBUG_OBJECT (rtcpsender, "new session %u", id);
+    session = gst_rtcpsender_session_new (id);
+    g_hash_table_insert (rtcpsender->sessions, GUINT_TO_POINTER (id), session);
+  }
+
+  return session;
+}
+
+/* frees @session once it has neither pads nor local ssrcs, called with
+ * the object lock */
+static void
+gst_rtcpsender_release_session (GstRtcpSender * rtcpsender,
+    GstRtcpSenderSession * session)
+{
+  if (session->id != 0 && session->srcpad == NULL &&
+      session->rtp_sink == NULL && session->n_locals == 0)
+    g_hash_table_remove (rtcpsender->sessions, GUINT_TO_POINTER (session->id));
+}
+
+/* a ref to the src pad of @session, NULL without. Called with the object
+ * lock. */
+static GstPad *
+gst_rtcpsender_session_pad (GstRtcpSenderSession * session)
+{
+  if (session == NULL || session->srcpad == NULL)
+    return NULL;
+
+  return gst_object_ref (session->srcpad);
+}
+
+static GstPad *
+gst_rtcpsender_request_session_pad (GstRtcpSender * rtcpsender,
+    GstPadTemplate * templ, const gchar * name)
+{
+  GstRtcpSenderSession *session;
+  GstPad *pad;
+  gchar *pad_name;
+  guint id;
+
+  GST_OBJECT_LOCK (rtcpsender);
+  if (name == NULL) {
+    id = rtcpsender->next_session;
+    while (id == 0 || ((session = g_hash_table_lookup (rtcpsender->sessions,
+                    GUINT_TO_POINTER (id))) && session->srcpad))
+      id++;
+    rtcpsender->next_session = id + 1;
+  } else if (sscanf (name, "src_%u", &id) != 1 || id == 0) {
+    goto invalid_name;
+  }
+
+  session = gst_rtcpsender_get_session (rtcpsender, id);
+  if (session->srcpad)
+    goto exists;
+
+  pad_name = g_strdup_printf ("src_%u", id);
+  pad = gst_pad_new_from_template (templ, pad_name);
+  g_free (pad_name);
+  session->srcpad = pad;
+  GST_OBJECT_UNLOCK (rtcpsender);
+
+  gst_pad_set_event_function (pad, gst_rtcpsender_src_event);
+
+  gst_pad_set_active (pad, TRUE);
+  gst_element_add_pad (GST_ELEMENT (rtcpsender), pad);
+
+  return pad;
+
+  /* ERRORS */
+invalid_name:
+  {
+    GST_OBJECT_UNLOCK (rtcpsender);
+    GST_WARNING_OBJECT (rtcpsender, "invalid pad name %s, session 0 is the "
+        "src pad", name);
+    return NULL;
+  }
+exists:
+  {
+    GST_OBJECT_UNLOCK (rtcpsender);
+    GST_WARNING_OBJECT (rtcpsender, "session %u has a pad already", id);
+    return NULL;
+  }
+}
+
+/* the RTP of session @id, its pad private data is the session */
+static GstPad *
+gst_rtcpsender_request_rtp_sink_pad (GstRtcpSender * rtcpsender,
+    GstPadTemplate * templ, const gchar * name)
+{
+  GstRtcpSenderSession *session;
+  GstPad *pad;
+  gchar *pad_name;
+  guint id;
+
+  GST_OBJECT_LOCK (rtcpsender);
+  if (name == NULL) {
+    id = rtcpsender->next_rtp_sink;
+    while ((session = g_hash_table_lookup (rtcpsender->sessions,
+                GUINT_TO_POINTER (id))) && session->rtp_sink)
+      id++;
+  } else if (sscanf (name, "rtp_sink_%u", &id) != 1) {
+    goto invalid_name;
+  }
+  /* later names are numbered after the requested ones */
+  rtcpsender->next_rtp_sink = MAX (rtcpsender->next_rtp_sink, id + 1);
+
+  session = gst_rtcpsender_get_session (rtcpsender, id);
+  if (session->rtp_sink)
+    goto exists;
+
+  pad_name = g_strdup_printf ("rtp_sink_%u", id);
+  pad = gst_pad_new_from_template (templ, pad_name);
+  g_free (pad_name);
+  session->rtp_sink = pad;
+  gst_pad_set_element_private (pad, session);
+  GST_OBJECT_UNLOCK (rtcpsender);
+
+  gst_pad_set_chain_function (pad, gst_rtcpsender_rtp_chain);
+  gst_pad_set_event_function (pad, gst_rtcpsender_rtp_event);
+
+  gst_pad_set_active (pad, TRUE);
+  gst_element_add_pad (GST_ELEMENT (rtcpsender), pad);
+
+  return pad;
+
+  /* ERRORS */
+invalid_name:
+  {
+    GST_OBJECT_UNLOCK (rtcpsender);
+    GST_WARNING_OBJECT (rtcpsender, "invalid pad name %s", name);
+    return NULL;
+  }
+exists:
+  {
+    GST_OBJECT_UNLOCK (rtcpsender);
+    GST_WARNING_OBJECT (rtcpsender, "session %u has an rtp_sink pad already",
+        id);
+    return NULL;
+  }
+}
+
+static GstPad *
+gst_rtcpsender_request_new_pad (GstElement * element, GstPadTemplate * templ,
+    const gchar * name, const GstCaps * caps)
+{
+  GstRtcpSender *rtcpsender = GST_RTCPSENDER (element);
+
+  if (templ == gst_element_class_get_pad_template (GST_ELEMENT_GET_CLASS
+          (element), "src_%u"))
+    return gst_rtcpsender_request_session_pad (rtcpsender, templ, name);
+
+  return gst_rtcpsender_request_rtp_sink_pad (rtcpsender, templ, name);
+}
+
+/* the local ssrcs of a session go with its src pad, and the feedback they
+ * still had to send. The statistics of the sources stay with the session
+ * as long as it has pads. */
+static void
+gst_rtcpsender_release_pad (GstElement * element, GstPad * pad)
+{
+  GstRtcpSender *rtcpsender = GST_RTCPSENDER (element);
+  GstRtcpSenderSession *session = NULL;
+  GstRtcpSenderLocal *local;
+  GHashTableIter iter;
+  gpointer value;
+
+  /* no chain function or push running on it anymore */
+  gst_pad_set_active (pad, FALSE);
+
+  GST_OBJECT_LOCK (rtcpsender);
+  g_hash_table_iter_init (&iter, rtcpsender->sessions);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    if (((GstRtcpSenderSession *) value)->srcpad == pad ||
+        ((GstRtcpSenderSession *) value)->rtp_sink == pad) {
+      session = value;
+      break;
+    }
+  }
+  if (session && session->srcpad == pad) {
+    g_hash_table_iter_init (&iter, rtcpsender->locals);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) & local)) {
+      if (local->session == session) {
+        g_hash_table_remove (rtcpsender->pending,
+            GUINT_TO_POINTER (local->ssrc));
+        g_hash_table_iter_remove (&iter);
+      }
+    }
+    session->n_locals = 0;
+    session->srcpad = NULL;
+    session->started = FALSE;
+    gst_rtcpsender_schedule (rtcpsender);
+  } else if (session) {
+    session->rtp_sink = NULL;
+  }
+  if (session)
+    gst_rtcpsender_release_session (rtcpsender, session);
+  GST_OBJECT_UNLOCK (rtcpsender);
+
+  gst_element_remove_pad (element, pad);
+}
+
+/* the rtp_sink pads end the stream, only the clock-rate of the caps is
+ * used, kept in the session */
+static gboolean
+gst_rtcpsender_rtp_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  GstRtcpSender *rtcpsender = GST_RTCPSENDER (parent);
+  GstRtcpSenderSession *session = gst_pad_get_element_private (pad);
+  const GstStructure *s;
+  GstCaps *caps;
+  gint clock_rate;
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_CAPS) {
+    gst_event_parse_caps (event, &caps);
+    s = gst_caps_get_structure (caps, 0);
+    if (gst_structure_get_int (s, "clock-rate", &clock_rate) &&
+        clock_rate > 0) {
+      GST_OBJECT_LOCK (rtcpsender);
+      session->clock_rate = clock_rate;
+      GST_OBJECT_UNLOCK (rtcpsender);
+    }
+  }
+
+  gst_event_unref (event);
+
+  return TRUE;
+}
+
+/* called with the object lock */
+static GstRtcpSenderSource *
+gst_rtcpsender_get_source (GstRtcpSender * rtcpsender,
+    GstRtcpSenderSession * session, guint32 ssrc)
+{
+  GstRtcpSenderSource *src;
+
+  src = g_hash_table_lookup (session->sources, GUINT_TO_POINTER (ssrc));
+  if (src == NULL) {
+    GST_DEBUG_OBJECT (rtcpsender, "new source %08x in session %u", ssrc,
+        session->id);
+    src = g_new0 (GstRtcpSenderSource, 1);
+    src->ssrc = ssrc;
+    g_hash_table_insert (session->sources, GUINT_TO_POINTER (ssrc), src);
+  }
+
+  return src;
+}
+
+static void
+gst_rtcpsender_init_seq (GstRtcpSenderSource * src, guint16 seq)
+{
+  src->base_seq = seq;
+  src->max_seq = seq;
+  src->bad_seq = RTP_SEQ_MOD + 1;
+  src->cycles = 0;
+  src->received = 0;
+  src->received_prior = 0;
+  src->expected_prior = 0;
+}
+
+/* RFC 3550 A.1, FALSE for packets not counted */
+static gboolean
+gst_rtcpsender_update_seq (GstRtcpSenderSource * src, guint16 seq)
+{
+  guint16 udelta = seq - src->max_seq;
+
+  if (!src->have_seq) {
+    gst_rtcpsender_init_seq (src, seq);
+    src->max_seq = seq - 1;
+    src->probation = MIN_SEQUENTIAL;
+    src->have_seq = TRUE;
+  }
+
+  if (src->probation) {
+    /* packets must be in sequence */
+    if (seq == (guint16) (src->max_seq + 1)) {
+      src->probation--;
+      src->max_seq = seq;
+      if (src->probation == 0) {
+        gst_rtcpsender_init_seq (src, seq);
+        src->received++;
+        return TRUE;
+      }
+    } else {
+      src->probation = MIN_SEQUENTIAL - 1;
+      src->max_seq = seq;
+    }
+    return FALSE;
+  } else if (udelta < MAX_DROPOUT) {
+    /* in order, with permissible gap */
+    if (seq < src->max_seq)
+      src->cycles += RTP_SEQ_MOD;
+    src->max_seq = seq;
+  } else if (udelta <= RTP_SEQ_MOD - MAX_MISORDER) {
+    /* a very large jump, twice in a row is a restarted sender */
+    if (seq == src->bad_seq) {
+      gst_rtcpsender_init_seq (src, seq);
+    } else {
+      src->bad_seq = (seq + 1) & (RTP_SEQ_MOD - 1);
+      return FALSE;
+    }
+  } else {
+    /* duplicate or reordered packet */
+  }
+  src->received++;
+
+  return TRUE;
+}
+
+static void
+gst_rtcpsender_process_rtp (GstRtcpSender * rtcpsender,
+    GstRtcpSenderSession * session, GstBuffer * buf, gint64 now)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstRtcpSenderSource *src;
+  guint32 ssrc, rtptime, arrival, transit;
+  guint16 seq;
+  gint32 d;
+
+  if (!gst_rtp_buffer_map (buf, GST_MAP_READ, &rtp)) {
+    GST_LOG_OBJECT (rtcpsender, "ignoring invalid RTP packet");
+    return;
+  }
+  ssrc = gst_rtp_buffer_get_ssrc (&rtp);
+  seq = gst_rtp_buffer_get_seq (&rtp);
+  rtptime = gst_rtp_buffer_get_timestamp (&rtp);
+  gst_rtp_buffer_unmap (&rtp);
+
+  GST_OBJECT_LOCK (rtcpsender);
+  src = gst_rtcpsender_get_source (rtcpsender, session, ssrc);
+  src->last_activity = now;
+  if (src->clock_rate == 0)
+    src->clock_rate = session->clock_rate;
+
+  /* RFC 3550 A.8, the arrival time in timestamp units */
+  if (gst_rtcpsender_update_seq (src, seq) && src->clock_rate > 0) {
+    arrival = gst_util_uint64_scale (now, src->clock_rate, G_USEC_PER_SEC);
+    transit = arrival - rtptime;
+    if (src->have_transit) {
+      d = transit - src->transit;
+      if (d < 0)
+        d = -d;
+      src->jitter += d - ((src->jitter + 8) >> 4);
+    }
+    src->transit = transit;
+    src->have_transit = TRUE;
+  }
+  GST_OBJECT_UNLOCK (rtcpsender);
+}
+
+/* keeps the time of the sender reports for LSR and DLSR */
+static void
+gst_rtcpsender_process_rtcp (GstRtcpSender * rtcpsender,
+    GstRtcpSenderSession * session, GstBuffer * buf, gint64 now)
+{
+  GstRTCPBuffer rtcp = GST_RTCP_BUFFER_INIT;
+  GstRtcpSenderSource *src;
+  GstRTCPPacket packet;
+  guint32 ssrc, rtptime, packet_count, octet_count;
+  guint64 ntptime;
+  gboolean more;
+
+  if (!gst_rtcp_buffer_validate (buf)) {
+    GST_LOG_OBJECT (rtcpsender, "ignoring invalid RTCP packet");
+    return;
+  }
+
+  gst_rtcp_buffer_map (buf, GST_MAP_READ, &rtcp);
+  GST_OBJECT_LOCK (rtcpsender);
+  more = gst_rtcp_buffer_get_first_packet (&rtcp, &packet);
+  while (more) {
+    if (gst_rtcp_packet_get_type (&packet) == GST_RTCP_TYPE_SR) {
+      gst_rtcp_packet_sr_get_sender_info (&packet, &ssrc, &ntptime, &rtptime,
+          &packet_count, &octet_count);
+      src = gst_rtcpsender_get_source (rtcpsender, session, ssrc);
+      src->lsr = (ntptime >> 16) & 0xffffffff;
+      src->sr_arrival = now;
+      src->last_activity = now;
+    }
+    more = gst_rtcp_packet_move_to_next (&packet);
+  }
+  GST_OBJECT_UNLOCK (rtcpsender);
+  gst_rtcp_buffer_unmap (&rtcp);
+}
+
 static GstFlowReturn
-gst_rtcpsender_send_rtcp (GstRtcpSender * rtcpsender, guint32 ssrc)
+gst_rtcpsender_rtp_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
+{
+  GstRtcpSender *rtcpsender = GST_RTCPSENDER (parent);
+  GstRtcpSenderSession *session = gst_pad_get_element_private (pad);
+  guint8 header[2];
+  gint64 now;
+
+  now = g_get_monotonic_time ();
+
+  /* RFC 5761, RTCP packet types in place of the marker and payload type */
+  if (gst_buffer_extract (buf, 0, header, 2) == 2 &&
+      header[1] >= 192 && header[1] <= 223)
+    gst_rtcpsender_process_rtcp (rtcpsender, session, buf, now);
+  else
+    gst_rtcpsender_process_rtp (rtcpsender, session, buf, now);
+
+  gst_buffer_unref (buf);
+
+  return GST_FLOW_OK;
+}
+
+/* RFC 3550 A.3, adds the report block of a source and starts a new
+ * interval. FALSE when the packet is full. Called with the object lock. */
+static gboolean
+gst_rtcpsender_add_report_block (GstRTCPPacket * packet,
+    GstRtcpSenderSource * src, gint64 now)
+{
+  guint32 extended_max, expected, expected_interval, received_interval;
+  guint32 dlsr = 0;
+  gint32 lost_interval;
+  gint64 lost;
+  guint8 fraction = 0;
+
+  extended_max = src->cycles + src->max_seq;
+  expected = extended_max - src->base_seq + 1;
+  lost = CLAMP ((gint64) expected - src->received, -0x800000, 0x7fffff);
+
+  expected_interval = expected - src->expected_prior;
+  received_interval = src->received - src->received_prior;
+  lost_interval = expected_interval - received_interval;
+  if (expected_interval > 0 && lost_interval > 0)
+    fraction = ((guint64) lost_interval << 8) / expected_interval;
+
+  if (src->sr_arrival > 0)
+    dlsr = gst_util_uint64_scale (now - src->sr_arrival, 65536,
+        G_USEC_PER_SEC);
+
+  if (!gst_rtcp_packet_add_rb (packet, src->ssrc, fraction, lost,
+          extended_max, src->jitter >> 4, src->lsr, dlsr))
+    return FALSE;
+
+  src->expected_prior = expected;
+  src->received_prior = src->received;
+
+  return TRUE;
+}
+
+/* the sources reported the longest ago first */
+static gint
+gst_rtcpsender_compare_reported (gconstpointer a, gconstpointer b)
+{
+  const GstRtcpSenderSource *sa = *(const GstRtcpSenderSource **) a;
+  const GstRtcpSenderSource *sb = *(const GstRtcpSenderSource **) b;
+
+  return sa->reported < sb->reported ? -1 : sa->reported > sb->reported;
+}
+
+/* RFC 3550 6.4, report blocks for the sources of @session RTP was received
+ * from since their last report. With more than fit in one report, the ones
+ * left out come first in the next. Sources silent for too long are
+ * forgotten. Called with the object lock. */
+static void
+gst_rtcpsender_add_report_blocks (GstRtcpSender * rtcpsender,
+    GstRtcpSenderSession * session, GstRTCPPacket * packet, gint64 now)
+{
+  GstRtcpSenderSource *src;
+  GHashTableIter iter;
+  GPtrArray *due;
+  gpointer value;
+  guint i;
+
+  due = g_ptr_array_new ();
+  g_hash_table_iter_init (&iter, session->sources);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    src = value;
+    if (now - src->last_activity > RTCP_SOURCE_TIMEOUT) {
+      GST_DEBUG_OBJECT (rtcpsender, "source %08x timed out", src->ssrc);
+      g_hash_table_iter_remove (&iter);
+      continue;
+    }
+    if (src->received != src->received_prior)
+      g_ptr_array_add (due, src);
+  }
+
+  if (due->len > RTCP_MAX_REPORT_BLOCKS)
+    g_ptr_array_sort (due, gst_rtcpsender_compare_reported);
+
+  session->report_round++;
+  for (i = 0; i < due->len && i < RTCP_MAX_REPORT_BLOCKS; i++) {
+    src = g_ptr_array_index (due, i);
+    if (!gst_rtcpsender_add_report_block (packet, src, now))
+      break;
+    src->reported = session->report_round;
+  }
+  g_ptr_array_free (due, TRUE);
+}
+
+/* stream-start, caps and segment before the first packet of a session,
+ * called with the stream lock of @pad. FALSE if the pad took none of it. */
+static gboolean
+gst_rtcpsender_start (GstRtcpSender * rtcpsender, GstPad * pad, guint id)
 {
   gchar* stream_id;
-  GstSegment* segment;
+  GstCaps *caps;
+  GstSegment segment;
+  gboolean res;
+
+  GST_DEBUG ("Need to send stream start event");
+
+  if (id == 0)
+    stream_id = gst_pad_create_stream_id (pad, &rtcpsender->parent, NULL);
+  else
+    stream_id = gst_pad_create_stream_id_printf (pad, &rtcpsender->parent,
+        "%u", id);
+  res = gst_pad_push_event (pad, gst_event_new_stream_start(stream_id));
+  g_free (stream_id);
+
+  gst_pad_use_fixed_caps (pad);
+  /* request pads are active from the start, a released one stays off */
+  if (pad == rtcpsender->srcpad)
+    gst_pad_set_active(pad, TRUE);
+  caps = gst_caps_from_string ("application/x-rtcp");
+  gst_pad_set_caps (pad, caps);
+  gst_caps_unref (caps);
+
+  gst_segment_init(&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (pad, gst_event_new_segment(&segment));
+
+  return res;
+}
+
+/* a compound packet of session @id, a receiver report from @ssrc followed
+ * by as many of the @n_fb feedback messages as fit in the MTU. @n_added is
+ * set to the number of messages consumed. */
+static GstBuffer *
+gst_rtcpsender_build (GstRtcpSender * rtcpsender, guint id, guint32 ssrc,
+    gboolean with_blocks, const GstRtcpSenderFeedback * fb, guint n_fb,
+    guint * n_added)
+{
+  GstRtcpSenderSession *session;
   GstBuffer *rtcpbuf;
   GstRTCPPacket packet;
   GstRTCPBuffer rtcp = GST_RTCP_BUFFER_INIT;
+  guint i;
+
+  *n_added = 0;
+
+  if (gst_buffer_pool_acquire_buffer (rtcpsender->pool, &rtcpbuf,
+          NULL) != GST_FLOW_OK)
+    goto no_buffer;
+
+  /* packets left from its last use would be taken for ours */
+  gst_buffer_set_size (rtcpbuf, RTCP_MTU_SIZE);
+  gst_buffer_memset (rtcpbuf, 0, 0, RTCP_MTU_SIZE);
+  gst_rtcp_buffer_map(rtcpbuf, GST_MAP_READWRITE, &rtcp);
+
+  gst_rtcp_buffer_add_packet (&rtcp, GST_RTCP_TYPE_RR, &packet);
+  gst_rtcp_packet_rr_set_ssrc(&packet, ssrc);
+
+  /* report blocks for the sources seen on the rtp_sink pad of the session,
+   * gone when its pads were released meanwhile */
+  if (with_blocks) {
+    GST_OBJECT_LOCK (rtcpsender);
+    session = g_hash_table_lookup (rtcpsender->sessions,
+        GUINT_TO_POINTER (id));
+    if (session)
+      gst_rtcpsender_add_report_blocks (rtcpsender, session, &packet,
+          g_get_monotonic_time ());
+    GST_OBJECT_UNLOCK (rtcpsender);
+  }
+
+  for (i = 0; i < n_fb; i++) {
+    if (!gst_rtcp_buffer_add_packet (&rtcp, fb[i].type, &packet))
+      goto no_space;
+
+    gst_rtcp_packet_fb_set_type (&packet, fb[i].fbtype);
+    gst_rtcp_packet_fb_set_sender_ssrc (&packet, ssrc);
+    gst_rtcp_packet_fb_set_media_ssrc (&packet, fb[i].media_ssrc);
+
+    if (fb[i].fci_len > 0) {
+      if (!gst_rtcp_packet_fb_set_fci_length (&packet, fb[i].fci_len)) {
+        gst_rtcp_packet_remove (&packet);
+        goto no_space;
+      }
+      memcpy (gst_rtcp_packet_fb_get_fci (&packet), fb[i].fci,
+          fb[i].fci_len * 4);
+    }
+  }
+  *n_added = n_fb;
+
+  gst_rtcp_buffer_unmap(&rtcp);
+
+  return rtcpbuf;
+
+  /* ERRORS */
+no_buffer:
+  {
+    GST_ERROR_OBJECT (rtcpsender, "could not get an RTCP buffer");
+    return NULL;
+  }
+no_space:
+  {
+    /* the rest goes in the next packet, unless even one does not fit */
+    *n_added = i;
+    if (i == 0) {
+      GST_WARNING_OBJECT (rtcpsender, "feedback message larger than the "
+          "MTU, dropped");
+      *n_added = 1;
+    }
+    gst_rtcp_buffer_unmap(&rtcp);
+    return rtcpbuf;
+  }
+}
+
+/* sends the receiver report of @ssrc with @n_fb feedback messages on the
+ * src pad of session @id, in as many compound packets as needed */
+static GstFlowReturn
+gst_rtcpsender_push_pad (GstRtcpSender * rtcpsender, GstPad * pad, guint id,
+    guint32 ssrc, const GstRtcpSenderFeedback * fb, guint n_fb)
+{
+  GstRtcpSenderSession *session;
+  GstBuffer *buf;
+  GstFlowReturn ret;
+  gboolean with_blocks = TRUE, started;
+  guint n_added;
+
+  /* signals may come from any thread, and the report task for the
+   * periodic reports and coalesced feedback */
+  GST_PAD_STREAM_LOCK (pad);
+  GST_OBJECT_LOCK (rtcpsender);
+  session = g_hash_table_lookup (rtcpsender->sessions, GUINT_TO_POINTER (id));
+  started = session == NULL || session->srcpad != pad || session->started;
+  GST_OBJECT_UNLOCK (rtcpsender);
+
+  /* a pad that is off takes nothing, it starts once it is back on */
+  if (!started && gst_rtcpsender_start (rtcpsender, pad, id)) {
+    GST_OBJECT_LOCK (rtcpsender);
+    session = g_hash_table_lookup (rtcpsender->sessions,
+        GUINT_TO_POINTER (id));
+    if (session && session->srcpad == pad)
+      session->started = TRUE;
+    GST_OBJECT_UNLOCK (rtcpsender);
+  }
+
+  do {
+    buf = gst_rtcpsender_build (rtcpsender, id, ssrc, with_blocks, fb, n_fb,
+        &n_added);
+    if (buf == NULL) {
+      ret = GST_FLOW_ERROR;
+      break;
+    }
+
+    /* RFC 3550 6.3.3, feedback sent at once counts too */
+    GST_OBJECT_LOCK (rtcpsender);
+    session = g_hash_table_lookup (rtcpsender->sessions,
+        GUINT_TO_POINTER (id));
+    if (session)
+      session->avg_rtcp_size += (gst_buffer_get_size (buf) +
+          UDP_IP_HEADER_SIZE - session->avg_rtcp_size) / 16.0;
+    GST_OBJECT_UNLOCK (rtcpsender);
+
+    ret = gst_pad_push (pad, buf);
+
+    /* the report blocks start a new interval, they go in the first only */
+    with_blocks = FALSE;
+    fb += n_added;
+    n_fb -= n_added;
+  } while (ret == GST_FLOW_OK && n_fb > 0);
+  GST_PAD_STREAM_UNLOCK (pad);
+
+  return ret;
+}
+
+/* sends in the session @ssrc was added to, session 0 for the others */
+static GstFlowReturn
+gst_rtcpsender_push (GstRtcpSender * rtcpsender, guint32 ssrc,
+    const GstRtcpSenderFeedback * fb, guint n_fb)
+{
+  GstRtcpSenderSession *session;
+  GstRtcpSenderLocal *local;
+  GstFlowReturn ret;
+  GstPad *pad;
+  guint id;
+
+  GST_OBJECT_LOCK (rtcpsender);
+  local = g_hash_table_lookup (rtcpsender->locals, GUINT_TO_POINTER (ssrc));
+  if (local)
+    session = local->session;
+  else
+    session = g_hash_table_lookup (rtcpsender->sessions, GUINT_TO_POINTER (0));
+  id = session->id;
+  pad = gst_rtcpsender_session_pad (session);
+  GST_OBJECT_UNLOCK (rtcpsender);
+
+  if (pad == NULL)
+    goto no_pad;
+
+  ret = gst_rtcpsender_push_pad (rtcpsender, pad, id, ssrc, fb, n_fb);
+  gst_object_unref (pad);
+
+  return ret;
+
+  /* ERRORS */
+no_pad:
+  {
+    GST_DEBUG_OBJECT (rtcpsender, "session %u of ssrc %08x has no pad", id,
+        ssrc);
+    return GST_FLOW_NOT_LINKED;
+  }
+}
+
+static void
+gst_rtcpsender_free_pending (gpointer data)
+{
+  GArray *items = data;
+  guint i;
+
+  for (i = 0; i < items->len; i++)
+    g_free (g_array_index (items, GstRtcpSenderFeedback, i).fci);
+  g_array_free (items, TRUE);
+}
+
+static GHashTable *
+gst_rtcpsender_new_pending (void)
+{
+  return g_hash_table_new_full (NULL, NULL, NULL, gst_rtcpsender_free_pending);
+}
+
+/* from the system clock thread at the end of a coalesce window, hands the
+ * feedback queued meanwhile to the report task like the periodic reports */
+static gboolean
+gst_rtcpsender_coalesce_timeout (GstClock * clock, GstClockTime time,
+    GstClockID id, gpointer user_data)
+{
+  GstRtcpSender *rtcpsender = GST_RTCPSENDER (user_data);
+
+  GST_OBJECT_LOCK (rtcpsender);
+  if (id == rtcpsender->coalesce_id) {
+    gst_clock_id_unref (rtcpsender->coalesce_id);
+    rtcpsender->coalesce_id = NULL;
+    rtcpsender->coalesce_due = TRUE;
+    g_cond_signal (&rtcpsender->due_cond);
+  }
+  GST_OBJECT_UNLOCK (rtcpsender);
+
+  return TRUE;
+}
+
+/* sends the feedback of an ended coalesce window, one compound packet per
+ * ssrc, from the report task */
+static void
+gst_rtcpsender_push_pending (GstRtcpSender * rtcpsender, GHashTable * pending)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  GstFlowReturn ret = GST_FLOW_OK, res;
+  GArray *items;
+
+  g_hash_table_iter_init (&iter, pending);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    items = value;
+    GST_LOG_OBJECT (rtcpsender, "%u feedback messages from ssrc %08x",
+        items->len, GPOINTER_TO_UINT (key));
+    res = gst_rtcpsender_push (rtcpsender, GPOINTER_TO_UINT (key),
+        (GstRtcpSenderFeedback *) items->data, items->len);
+    if (res != GST_FLOW_OK)
+      ret = res;
+  }
 
-  if (!rtcpsender->started) {
-    GST_DEBUG ("Need to send stream start event");
+  /* the caller of the window is gone, the next one gets it */
+  GST_OBJECT_LOCK (rtcpsender);
+  rtcpsender->coalesce_ret = ret;
+  GST_OBJECT_UNLOCK (rtcpsender);
+}
 
-    stream_id = gst_pad_create_stream_id (rtcpsender->srcpad, &rtcpsender->parent, NULL);
-    gst_pad_push_event (rtcpsender->srcpad, gst_event_new_stream_start(stream_id));
+/* sends @fb at once, or queues a copy until the end of the coalesce
+ * window. A queued message returns how sending the last window went. */
+static GstFlowReturn
+gst_rtcpsender_feedback (GstRtcpSender * rtcpsender, guint32 ssrc,
+    const GstRtcpSenderFeedback * fb)
+{
+  GstRtcpSenderFeedback copy;
+  GstFlowReturn ret;
+  GstClock *clock;
+  GArray *items;
 
-    gst_pad_use_fixed_caps (rtcpsender->srcpad);
-    gst_pad_set_active(rtcpsender->srcpad, TRUE);
-    gst_pad_set_caps (rtcpsender->srcpad, gst_caps_from_string ("application/x-rtcp"));
+  GST_OBJECT_LOCK (rtcpsender);
+  if (rtcpsender->coalesce_window == 0) {
+    GST_OBJECT_UNLOCK (rtcpsender);
+    return gst_rtcpsender_push (rtcpsender, ssrc, fb, 1);
+  }
 
-    segment = gst_segment_new();
-    gst_segment_init(segment, GST_FORMAT_TIME);
-    gst_pad_push_event (rtcpsender->srcpad, gst_event_new_segment(segment));
+  items = g_hash_table_lookup (rtcpsender->pending, GUINT_TO_POINTER (ssrc));
+  if (items == NULL) {
+    items = g_array_new (FALSE, FALSE, sizeof (GstRtcpSenderFeedback));
+    g_hash_table_insert (rtcpsender->pending, GUINT_TO_POINTER (ssrc), items);
+  }
+  copy = *fb;
+  copy.fci = g_memdup2 (fb->fci, fb->fci_len * 4);
+  g_array_append_val (items, copy);
 
-    rtcpsender->started = TRUE;
+  /* the first message of the window starts it */
+  if (rtcpsender->coalesce_id == NULL) {
+    clock = gst_system_clock_obtain ();
+    rtcpsender->coalesce_id = gst_clock_new_single_shot_id (clock,
+        gst_clock_get_time (clock) +
+        rtcpsender->coalesce_window * GST_MSECOND);
+    gst_clock_id_wait_async (rtcpsender->coalesce_id,
+        gst_rtcpsender_coalesce_timeout, gst_object_ref (rtcpsender),
+        (GDestroyNotify) gst_object_unref);
+    gst_object_unref (clock);
   }
+  ret = rtcpsender->coalesce_ret;
+  rtcpsender->coalesce_ret = GST_FLOW_OK;
+  GST_OBJECT_UNLOCK (rtcpsender);
 
+  return ret;
+}
+
+/* chain function
+ * this function does the actual processing
+ */
+static GstFlowReturn
+gst_rtcpsender_send_rtcp (GstRtcpSender * rtcpsender, guint32 ssrc)
+{
   GST_DEBUG ("Got signal action. Preparing RTCP packet");
 
-  rtcpbuf = gst_rtcp_buffer_new (RTCP_MTU_SIZE);
-  gst_rtcp_buffer_map(rtcpbuf, GST_MAP_READWRITE, &rtcp);
+  return gst_rtcpsender_push (rtcpsender, ssrc, NULL, 0);
+}
 
-  gst_rtcp_buffer_get_first_packet (&rtcp, &packet);
+static GstFlowReturn
+gst_rtcpsender_send_session_rtcp (GstRtcpSender * rtcpsender, guint session,
+    guint32 ssrc)
+{
+  GstFlowReturn ret;
+  GstPad *pad;
 
-  gst_rtcp_buffer_add_packet (&rtcp, GST_RTCP_TYPE_RR, &packet);
-  gst_rtcp_packet_rr_set_ssrc(&packet, ssrc);
+  GST_OBJECT_LOCK (rtcpsender);
+  pad = gst_rtcpsender_session_pad (g_hash_table_lookup (rtcpsender->sessions,
+          GUINT_TO_POINTER (session)));
+  GST_OBJECT_UNLOCK (rtcpsender);
 
-  gst_rtcp_buffer_unmap(&rtcp);
+  if (pad == NULL)
+    goto no_pad;
+
+  ret = gst_rtcpsender_push_pad (rtcpsender, pad, session, ssrc, NULL, 0);
+  gst_object_unref (pad);
+
+  return ret;
+
+  /* ERRORS */
+no_pad:
+  {
+    GST_DEBUG_OBJECT (rtcpsender, "session %u has no pad", session);
+    return GST_FLOW_NOT_LINKED;
+  }
+}
+
+/* picture loss indication, RFC 4585 6.3.1 */
+static GstFlowReturn
+gst_rtcpsender_send_pli (GstRtcpSender * rtcpsender, guint32 ssrc,
+    guint32 media_ssrc)
+{
+  GstRtcpSenderFeedback fb = { GST_RTCP_TYPE_PSFB, GST_RTCP_PSFB_TYPE_PLI,
+    media_ssrc, NULL, 0 };
+
+  GST_DEBUG_OBJECT (rtcpsender, "PLI for ssrc %08x", media_ssrc);
+
+  return gst_rtcpsender_feedback (rtcpsender, ssrc, &fb);
+}
+
+/* full intra request, RFC 5104 4.3.1. The media ssrc goes in the FCI with
+ * a command sequence number counted per media ssrc. */
+static GstFlowReturn
+gst_rtcpsender_send_fir (GstRtcpSender * rtcpsender, guint32 ssrc,
+    guint32 media_ssrc)
+{
+  GstRtcpSenderFeedback fb = { GST_RTCP_TYPE_PSFB, GST_RTCP_PSFB_TYPE_FIR,
+    0, NULL, 2 };
+  guint8 fci[8] = { 0, };
+  guint seqnum;
+
+  GST_OBJECT_LOCK (rtcpsender);
+  seqnum = GPOINTER_TO_UINT (g_hash_table_lookup (rtcpsender->fir_seqnums,
+          GUINT_TO_POINTER (media_ssrc)));
+  g_hash_table_insert (rtcpsender->fir_seqnums, GUINT_TO_POINTER (media_ssrc),
+      GUINT_TO_POINTER ((seqnum + 1) & 0xff));
+  GST_OBJECT_UNLOCK (rtcpsender);
+
+  GST_DEBUG_OBJECT (rtcpsender, "FIR %u for ssrc %08x", seqnum, media_ssrc);
+
+  GST_WRITE_UINT32_BE (fci, media_ssrc);
+  fci[4] = seqnum;
+  fb.fci = fci;
+
+  return gst_rtcpsender_feedback (rtcpsender, ssrc, &fb);
+}
+
+/* generic NACK, RFC 4585 6.2.1. Every FCI word is a lost packet id and a
+ * bitmask of the 16 sequence numbers after it that are lost too. */
+static GstFlowReturn
+gst_rtcpsender_send_nack (GstRtcpSender * rtcpsender, guint32 ssrc,
+    guint32 media_ssrc, GArray * seqnums)
+{
+  GstRtcpSenderFeedback fb = { GST_RTCP_TYPE_RTPFB, GST_RTCP_RTPFB_TYPE_NACK,
+    media_ssrc, NULL, 0 };
+  GstFlowReturn ret;
+  guint16 seq, pid = 0, blp = 0, diff;
+  guint i;
+
+  if (seqnums == NULL || seqnums->len == 0)
+    return GST_FLOW_OK;
+
+  fb.fci = g_malloc (seqnums->len * 4);
+  for (i = 0; i < seqnums->len; i++) {
+    seq = g_array_index (seqnums, guint, i) & 0xffff;
+    diff = seq - pid;
+
+    if (fb.fci_len > 0 && diff == 0)
+      continue;
+
+    if (fb.fci_len > 0 && diff <= 16) {
+      blp |= 1 << (diff - 1);
+      GST_WRITE_UINT16_BE (fb.fci + (fb.fci_len - 1) * 4 + 2, blp);
+      continue;
+    }
+
+    pid = seq;
+    blp = 0;
+    GST_WRITE_UINT16_BE (fb.fci + fb.fci_len * 4, pid);
+    GST_WRITE_UINT16_BE (fb.fci + fb.fci_len * 4 + 2, blp);
+    fb.fci_len++;
+  }
+
+  GST_DEBUG_OBJECT (rtcpsender, "NACK for %u packets of ssrc %08x in %u "
+      "words", seqnums->len, media_ssrc, fb.fci_len);
+
+  ret = gst_rtcpsender_feedback (rtcpsender, ssrc, &fb);
+  g_free (fb.fci);
+
+  return ret;
+}
+
+/* receiver estimated maximum bitrate, draft-alvestrand-rmcat-remb. An
+ * application layer PSFB with an 18 bit mantissa and 6 bit exponent. */
+static GstFlowReturn
+gst_rtcpsender_send_remb (GstRtcpSender * rtcpsender, guint32 ssrc,
+    guint64 bitrate, GArray * ssrcs)
+{
+  GstRtcpSenderFeedback fb = { GST_RTCP_TYPE_PSFB, GST_RTCP_PSFB_TYPE_AFB,
+    0, NULL, 0 };
+  GstFlowReturn ret;
+  guint64 mantissa = bitrate;
+  guint exp = 0, n_ssrcs, i;
+
+  n_ssrcs = ssrcs ? MIN (ssrcs->len, 255) : 0;
+
+  while (mantissa > 0x3ffff) {
+    mantissa >>= 1;
+    exp++;
+  }
+
+  fb.fci_len = 2 + n_ssrcs;
+  fb.fci = g_malloc (fb.fci_len * 4);
+  memcpy (fb.fci, "REMB", 4);
+  fb.fci[4] = n_ssrcs;
+  fb.fci[5] = (exp << 2) | (mantissa >> 16);
+  GST_WRITE_UINT16_BE (fb.fci + 6, mantissa & 0xffff);
+  for (i = 0; i < n_ssrcs; i++)
+    GST_WRITE_UINT32_BE (fb.fci + 8 + i * 4, g_array_index (ssrcs, guint, i));
+
+  GST_DEBUG_OBJECT (rtcpsender, "REMB %" G_GUINT64_FORMAT " bps for %u "
+      "ssrcs", bitrate, n_ssrcs);
+
+  ret = gst_rtcpsender_feedback (rtcpsender, ssrc, &fb);
+  g_free (fb.fci);
+
+  return ret;
+}
+
+/* remote senders of @session, the sources with valid packets. Called with
+ * the object lock. */
+static guint
+gst_rtcpsender_count_senders (GstRtcpSenderSession * session)
+{
+  GHashTableIter iter;
+  gpointer value;
+  guint senders = 0;
+
+  g_hash_table_iter_init (&iter, session->sources);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    if (((GstRtcpSenderSource *) value)->received > 0)
+      senders++;
+  }
+
+  return senders;
+}
+
+/* randomized report interval of RFC 3550 6.3.1 and A.7 for a receiver in
+ * @session, from its own members and packet size. All the local ssrcs only
+ * send receiver reports. Called with the object lock. */
+static GstClockTime
+gst_rtcpsender_interval (GstRtcpSender * rtcpsender,
+    GstRtcpSenderSession * session, gboolean initial)
+{
+  gdouble rtcp_bw, members, n, t, tmin;
+  guint senders;
+
+  senders = gst_rtcpsender_count_senders (session);
+  members = senders + session->n_locals;
+
+  /* reduced minimum of RFC 3550 6.2 */
+  if (rtcpsender->reduced_minimum && rtcpsender->bandwidth > 0)
+    tmin = 360.0 / (rtcpsender->bandwidth / 1000.0);
+  else
+    tmin = initial ? RTCP_MIN_INTERVAL / 2 : RTCP_MIN_INTERVAL;
+
+  /* in bytes per second, a quarter is for the senders when they are few */
+  rtcp_bw = rtcpsender->bandwidth / 8.0 * rtcpsender->rtcp_fraction;
+  n = members;
+  if (senders <= members * 0.25) {
+    rtcp_bw *= 0.75;
+    n = members - senders;
+  }
+
+  t = tmin;
+  if (rtcp_bw > 0)
+    t = MAX (t, session->avg_rtcp_size * n / rtcp_bw);
+
+  t = t * g_random_double_range (0.5, 1.5) / RTCP_COMPENSATION;
+
+  return t * GST_SECOND;
+}
+
+static gboolean gst_rtcpsender_timeout (GstClock * clock, GstClockTime time,
+    GstClockID id, gpointer user_data);
+
+/* waits for the earliest report of the local ssrcs, or nothing when not
+ * PLAYING. Called with the object lock. */
+static void
+gst_rtcpsender_schedule (GstRtcpSender * rtcpsender)
+{
+  GstRtcpSenderLocal *local;
+  GHashTableIter iter;
+  GstClockTime next = GST_CLOCK_TIME_NONE;
+
+  if (rtcpsender->clock) {
+    g_hash_table_iter_init (&iter, rtcpsender->locals);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) & local))
+      next = MIN (next, local->next);
+  }
+
+  if (rtcpsender->clock_id) {
+    if (rtcpsender->clock_next == next)
+      return;
+    gst_clock_id_unschedule (rtcpsender->clock_id);
+    gst_clock_id_unref (rtcpsender->clock_id);
+    rtcpsender->clock_id = NULL;
+  }
+
+  if (!GST_CLOCK_TIME_IS_VALID (next))
+    return;
+
+  rtcpsender->clock_id = gst_clock_new_single_shot_id (rtcpsender->clock, next);
+  rtcpsender->clock_next = next;
+  gst_clock_id_wait_async (rtcpsender->clock_id, gst_rtcpsender_timeout,
+      gst_object_ref (rtcpsender), (GDestroyNotify) gst_object_unref);
+}
+
+/* from the clock thread, hands the reports that are due to the task.
+ * Pushing here would hold up the other entries of the clock. */
+static gboolean
+gst_rtcpsender_timeout (GstClock * clock, GstClockTime time, GstClockID id,
+    gpointer user_data)
+{
+  GstRtcpSender *rtcpsender = GST_RTCPSENDER (user_data);
+  GstRtcpSenderLocal *local;
+  GHashTableIter iter;
+  GstClockTime now;
+  guint n_due;
+
+  GST_OBJECT_LOCK (rtcpsender);
+  /* replaced or unscheduled meanwhile */
+  if (id != rtcpsender->clock_id) {
+    GST_OBJECT_UNLOCK (rtcpsender);
+    return TRUE;
+  }
+  gst_clock_id_unref (rtcpsender->clock_id);
+  rtcpsender->clock_id = NULL;
+
+  now = gst_clock_get_time (clock);
+  n_due = rtcpsender->due->len;
+
+  g_hash_table_iter_init (&iter, rtcpsender->locals);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) & local)) {
+    if (local->next <= now) {
+      g_array_append_val (rtcpsender->due, local->ssrc);
+      local->next = now + gst_rtcpsender_interval (rtcpsender,
+          local->session, FALSE);
+    }
+  }
+  if (rtcpsender->due->len > n_due)
+    g_cond_signal (&rtcpsender->due_cond);
+  gst_rtcpsender_schedule (rtcpsender);
+  GST_OBJECT_UNLOCK (rtcpsender);
+
+  return TRUE;
+}
+
+/* the report task, sends the reports the clock entry found due and the
+ * feedback of ended coalesce windows */
+static void
+gst_rtcpsender_report_loop (GstRtcpSender * rtcpsender)
+{
+  GHashTable *pending = NULL;
+  GArray *due;
+  guint i;
+
+  GST_OBJECT_LOCK (rtcpsender);
+  while (rtcpsender->reporting && rtcpsender->due->len == 0 &&
+      !rtcpsender->coalesce_due)
+    g_cond_wait (&rtcpsender->due_cond, GST_OBJECT_GET_LOCK (rtcpsender));
+  if (!rtcpsender->reporting) {
+    /* stopped, the task returns once it sees it */
+    GST_OBJECT_UNLOCK (rtcpsender);
+    return;
+  }
+  due = rtcpsender->due;
+  rtcpsender->due = g_array_new (FALSE, FALSE, sizeof (guint32));
+  if (rtcpsender->coalesce_due) {
+    rtcpsender->coalesce_due = FALSE;
+    pending = rtcpsender->pending;
+    rtcpsender->pending = gst_rtcpsender_new_pending ();
+  }
+  GST_OBJECT_UNLOCK (rtcpsender);
+
+  for (i = 0; i < due->len; i++)
+    gst_rtcpsender_push (rtcpsender, g_array_index (due, guint32, i), NULL, 0);
+  g_array_free (due, TRUE);
+
+  if (pending) {
+    gst_rtcpsender_push_pending (rtcpsender, pending);
+    g_hash_table_destroy (pending);
+  }
+}
+
+static void
+gst_rtcpsender_add_ssrc (GstRtcpSender * rtcpsender, guint32 ssrc)
+{
+  gst_rtcpsender_add_session_ssrc (rtcpsender, 0, ssrc);
+}
+
+/* ssrcs are unique over all the sessions */
+static void
+gst_rtcpsender_add_session_ssrc (GstRtcpSender * rtcpsender, guint session,
+    guint32 ssrc)
+{
+  GstRtcpSenderLocal *local;
+
+  GST_OBJECT_LOCK (rtcpsender);
+  if (g_hash_table_lookup (rtcpsender->locals, GUINT_TO_POINTER (ssrc)))
+    goto exists;
+
+  GST_DEBUG_OBJECT (rtcpsender, "periodic reports from ssrc %08x in "
+      "session %u", ssrc, session);
+
+  local = g_new0 (GstRtcpSenderLocal, 1);
+  local->ssrc = ssrc;
+  local->session = gst_rtcpsender_get_session (rtcpsender, session);
+  local->session->n_locals++;
+  local->next = GST_CLOCK_TIME_NONE;
+  g_hash_table_insert (rtcpsender->locals, GUINT_TO_POINTER (ssrc), local);
+
+  if (rtcpsender->clock) {
+    local->next = gst_clock_get_time (rtcpsender->clock) +
+        gst_rtcpsender_interval (rtcpsender, local->session, TRUE);
+    gst_rtcpsender_schedule (rtcpsender);
+  }
+  GST_OBJECT_UNLOCK (rtcpsender);
+
+  return;
+
+  /* ERRORS */
+exists:
+  {
+    GST_OBJECT_UNLOCK (rtcpsender);
+    GST_WARNING_OBJECT (rtcpsender, "ssrc %08x was added already", ssrc);
+    return;
+  }
+}
+
+static void
+gst_rtcpsender_remove_ssrc (GstRtcpSender * rtcpsender, guint32 ssrc)
+{
+  GstRtcpSenderSession *session;
+  GstRtcpSenderLocal *local;
+
+  GST_OBJECT_LOCK (rtcpsender);
+  local = g_hash_table_lookup (rtcpsender->locals, GUINT_TO_POINTER (ssrc));
+  if (local) {
+    session = local->session;
+    g_hash_table_remove (rtcpsender->locals, GUINT_TO_POINTER (ssrc));
+    session->n_locals--;
+    gst_rtcpsender_release_session (rtcpsender, session);
+    gst_rtcpsender_schedule (rtcpsender);
+  }
+  GST_OBJECT_UNLOCK (rtcpsender);
+}
+
+static GstStateChangeReturn
+gst_rtcpsender_change_state (GstElement * element, GstStateChange transition)
+{
+  GstRtcpSender *rtcpsender = GST_RTCPSENDER (element);
+  GstRtcpSenderLocal *local;
+  GstStateChangeReturn ret;
+  GHashTableIter iter;
+  gpointer value;
+  GstClock *clock;
+  GstClockTime now;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      GST_OBJECT_LOCK (rtcpsender);
+      rtcpsender->reporting = TRUE;
+      GST_OBJECT_UNLOCK (rtcpsender);
+      gst_task_start (rtcpsender->task);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
+      /* the reports follow the pipeline clock */
+      clock = gst_element_get_clock (element);
+      if (clock == NULL) {
+        GST_WARNING_OBJECT (rtcpsender, "no clock, no periodic reports");
+        break;
+      }
+      GST_OBJECT_LOCK (rtcpsender);
+      rtcpsender->clock = clock;
+      now = gst_clock_get_time (clock);
+      g_hash_table_iter_init (&iter, rtcpsender->locals);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *) & local))
+        local->next = now + gst_rtcpsender_interval (rtcpsender,
+            local->session, TRUE);
+      gst_rtcpsender_schedule (rtcpsender);
+      GST_OBJECT_UNLOCK (rtcpsender);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+      GST_OBJECT_LOCK (rtcpsender);
+      clock = rtcpsender->clock;
+      rtcpsender->clock = NULL;
+      gst_rtcpsender_schedule (rtcpsender);
+      GST_OBJECT_UNLOCK (rtcpsender);
+      if (clock)
+        gst_object_unref (clock);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      /* the pads are inactive, a push in progress returns at once */
+      gst_task_stop (rtcpsender->task);
+      GST_OBJECT_LOCK (rtcpsender);
+      rtcpsender->reporting = FALSE;
+      g_array_set_size (rtcpsender->due, 0);
+      g_cond_signal (&rtcpsender->due_cond);
+      GST_OBJECT_UNLOCK (rtcpsender);
+      gst_task_join (rtcpsender->task);
+
+      /* feedback still held is for a stream that has ended */
+      GST_OBJECT_LOCK (rtcpsender);
+      if (rtcpsender->coalesce_id) {
+        gst_clock_id_unschedule (rtcpsender->coalesce_id);
+        gst_clock_id_unref (rtcpsender->coalesce_id);
+        rtcpsender->coalesce_id = NULL;
+      }
+      g_hash_table_remove_all (rtcpsender->pending);
+      rtcpsender->coalesce_due = FALSE;
+      rtcpsender->coalesce_ret = GST_FLOW_OK;
+
+      /* the pads are reset, the next report starts each session again */
+      g_hash_table_iter_init (&iter, rtcpsender->sessions);
+      while (g_hash_table_iter_next (&iter, NULL, &value))
+        ((GstRtcpSenderSession *) value)->started = FALSE;
+      GST_OBJECT_UNLOCK (rtcpsender);
+      break;
+    default:
+      break;
+  }
 
-  return gst_pad_push (rtcpsender->srcpad, rtcpbuf);
+  return ret;
 }
 
 
@@ -47,6 +47,7 @@
 #define __GST_RTCPSENDER_H__
 
 #include <gst/gst.h>
+#include <gst/rtp/gstrtcpbuffer.h>
 
 
 /* #defines don't like whitespacey bits */
@@ -58,14 +59,132 @@
 
 typedef struct _GstRtcpSender      GstRtcpSender;
 typedef struct _GstRtcpSenderClass GstRtcpSenderClass;
+typedef struct _GstRtcpSenderFeedback GstRtcpSenderFeedback;
+typedef struct _GstRtcpSenderSource GstRtcpSenderSource;
+typedef struct _GstRtcpSenderLocal GstRtcpSenderLocal;
+typedef struct _GstRtcpSenderSession GstRtcpSenderSession;
+
+/*
+ * One RTPFB or PSFB message, appended to the receiver report.
+ */
+struct _GstRtcpSenderFeedback
+{
+  GstRTCPType type;		/* GST_RTCP_TYPE_RTPFB or GST_RTCP_TYPE_PSFB */
+  GstRTCPFBType fbtype;
+  guint32 media_ssrc;
+  guint8 *fci;			/* feedback control information */
+  guint16 fci_len;		/* in 32 bit words */
+};
+
+/*
+ * Reception statistics of one RTP sender, as in RFC 3550 appendix A.
+ */
+struct _GstRtcpSenderSource
+{
+  guint32 ssrc;
+  guint32 clock_rate;		/* of its session, 0 if unknown */
+
+  /* sequence numbers */
+  gboolean have_seq;
+  guint16 max_seq;		/* highest seen */
+  guint32 cycles;		/* shifted count of wraps */
+  guint32 base_seq;
+  guint32 bad_seq;		/* last 'bad' seq number + 1 */
+  guint32 probation;		/* packets until the source is valid */
+  guint32 received;
+  guint32 expected_prior;	/* at the last report */
+  guint32 received_prior;
+
+  /* interarrival jitter, in timestamp units times 16 */
+  guint32 transit;
+  guint32 jitter;
+  gboolean have_transit;
+
+  /* last sender report */
+  guint32 lsr;			/* middle 32 bits of its NTP time */
+  gint64 sr_arrival;		/* monotonic time, microseconds */
+
+  gint64 last_activity;		/* monotonic time of its last packet */
+  guint64 reported;		/* round of its last report block, 0 for none */
+};
+
+/*
+ * An RTCP session, sent on a src pad of its own. Session 0 is the always
+ * src pad, the others are src_%u request pads. The RTP it reports on comes
+ * in on the rtp_sink_%u pad of the same number. A session without pads
+ * lives as long as local ssrcs are added to it.
+ */
+struct _GstRtcpSenderSession
+{
+  guint id;
+  GstPad *srcpad;		/* NULL until requested */
+  gboolean started;		/* stream-start, caps and segment sent on it */
+  GstPad *rtp_sink;		/* NULL until requested */
+  guint n_locals;		/* local ssrcs reporting in the session */
+
+  guint32 clock_rate;		/* of the rtp_sink pad caps, 0 if unknown */
+  /* ssrc -> GstRtcpSenderSource of the RTP seen on the rtp_sink pad */
+  GHashTable *sources;
+  guint64 report_round;		/* receiver reports built so far */
+  gdouble avg_rtcp_size;	/* bytes, with the UDP and IP headers */
+};
+
+/*
+ * A local ssrc sending receiver reports on its own, at RFC 3550 intervals.
+ */
+struct _GstRtcpSenderLocal
+{
+  guint32 ssrc;
+  GstRtcpSenderSession *session;
+  GstClockTime next;		/* clock time of its next report */
+};
 
 struct _GstRtcpSender
 {
   GstElement parent;   	/* parent class */
 
-  gboolean started;
+  GstPad *srcpad;		/* src pad, session 0 */
+
+  /* id -> GstRtcpSenderSession, with the sources of each, protected by
+   * the object lock */
+  GHashTable *sessions;
+  guint next_session;
+  guint next_rtp_sink;
+
+  /* next FIR command sequence number of each media ssrc, protected by
+   * the object lock */
+  GHashTable *fir_seqnums;
+
+
+  /* properties, protected by the object lock */
+  guint bandwidth;		/* session bandwidth, bits per second */
+  gdouble rtcp_fraction;
+  gboolean reduced_minimum;
+
+  /* periodic reports, protected by the object lock. A single clock entry
+   * waits for the earliest report of all the local ssrcs. */
+  GHashTable *locals;		/* ssrc -> GstRtcpSenderLocal, all sessions */
+  GstClock *clock;		/* while PLAYING */
+  GstClockID clock_id;
+  GstClockTime clock_next;
+
+  /* the task sending the reports the clock entry found due and the
+   * feedback of ended coalesce windows, between PAUSED and READY. due is
+   * protected by the object lock. */
+  GstTask *task;
+  GRecMutex task_lock;
+  GArray *due;			/* guint32 ssrcs */
+  GCond due_cond;
+  gboolean reporting;
+
+  GstBufferPool *pool;		/* of MTU sized buffers */
 
-  GstPad *srcpad;		/* src pad */
+  /* feedback coalescing, protected by the object lock */
+  guint coalesce_window;	/* milliseconds, property */
+  GHashTable *pending;		/* ssrc -> GArray of GstRtcpSenderFeedback */
+  GstClockID coalesce_id;	/* end of the window, on the system clock */
+  gboolean coalesce_due;	/* the window ended, pending is for the task */
+  GstFlowReturn coalesce_ret;	/* of the last window, for the next message */
 };
 
 struct _GstRtcpSenderClass
@@ -73,6 +192,20 @@ struct _GstRtcpSenderClass
   GstElementClass parent_class;
 
   GstFlowReturn (*send_rtcp) (GstRtcpSender *rtcpsender, guint32 ssrc);
+  GstFlowReturn (*send_pli) (GstRtcpSender *rtcpsender, guint32 ssrc,
+      guint32 media_ssrc);
+  GstFlowReturn (*send_fir) (GstRtcpSender *rtcpsender, guint32 ssrc,
+      guint32 media_ssrc);
+  GstFlowReturn (*send_nack) (GstRtcpSender *rtcpsender, guint32 ssrc,
+      guint32 media_ssrc, GArray *seqnums);
+  GstFlowReturn (*send_remb) (GstRtcpSender *rtcpsender, guint32 ssrc,
+      guint64 bitrate, GArray *ssrcs);
+  void (*add_ssrc) (GstRtcpSender *rtcpsender, guint32 ssrc);
+  void (*remove_ssrc) (GstRtcpSender *rtcpsender, guint32 ssrc);
+  void (*add_session_ssrc) (GstRtcpSender *rtcpsender, guint session,
+      guint32 ssrc);
+  GstFlowReturn (*send_session_rtcp) (GstRtcpSender *rtcpsender,
+      guint session, guint32 ssrc);
 };
 
 GType gst_rtcpsender_get_type (void);
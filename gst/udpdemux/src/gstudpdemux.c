@@ -31,6 +31,7 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <gst/gst.h>
@@ -43,23 +44,33 @@ GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_ALWAYS,
     GST_STATIC_CAPS_ANY);
 
-static GstStaticPadTemplate src_control_template =
-GST_STATIC_PAD_TEMPLATE ("src_0",
+/* one pad per type byte, created on the first packet of that type */
+static GstStaticPadTemplate src_template =
+GST_STATIC_PAD_TEMPLATE ("src_%u",
     GST_PAD_SRC,
-    GST_PAD_ALWAYS,
+    GST_PAD_SOMETIMES,
     GST_STATIC_CAPS_ANY);
 
-static GstStaticPadTemplate src_video_template =
-GST_STATIC_PAD_TEMPLATE ("src_1",
-    GST_PAD_SRC,
-    GST_PAD_ALWAYS,
-    GST_STATIC_CAPS_ANY);
+/* caps of types without an entry in type-caps */
+#define DEFAULT_TYPE_CAPS "application/octet-stream"
+#define DEFAULT_DROP_UNMAPPED FALSE
 
-static GstStaticPadTemplate src_audio_template =
-GST_STATIC_PAD_TEMPLATE ("src_2",
-    GST_PAD_SRC,
-    GST_PAD_ALWAYS,
-    GST_STATIC_CAPS_ANY);
+/* the first byte is the type, as with the original wire format */
+#define DEFAULT_KEY_OFFSET 0
+#define DEFAULT_KEY_WIDTH 1
+#define DEFAULT_KEY_MASK G_MAXUINT32
+#define DEFAULT_STRIP_BYTES 1
+
+/* no queues, src pads are pushed from the sink thread */
+#define DEFAULT_MAX_SIZE_BUFFERS 0
+#define DEFAULT_LEAKY GST_UDPDEMUX_LEAKY_NONE
+
+/* no reordering, a 16 bit sequence number would follow the type byte */
+#define DEFAULT_SEQ_OFFSET 1
+#define DEFAULT_SEQ_WIDTH 2
+#define DEFAULT_REORDER_WINDOW 0
+#define DEFAULT_REORDER_LATENCY 50
+#define DEFAULT_DROP_LATE TRUE
 
 GST_DEBUG_CATEGORY_STATIC (gst_udpdemux_debug);
 #define GST_CAT_DEFAULT gst_udpdemux_debug
@@ -78,6 +89,8 @@ static gboolean gst_udpdemux_src_event (GstPad * pad, GstObject * parent,
     GstEvent * event);
 static GstFlowReturn gst_udpdemux_chain (GstPad * pad, GstObject * parent,
     GstBuffer * buf);
+static GstFlowReturn gst_udpdemux_chain_list (GstPad * pad,
+    GstObject * parent, GstBufferList * list);
 static GstStateChangeReturn gst_udpdemux_change_state (GstElement * element,
     GstStateChange transition);
 
@@ -92,8 +105,45 @@ enum
   PROP_CAPS_CONTROL,
   PROP_CAPS_VIDEO,
   PROP_CAPS_AUDIO,
+  PROP_TYPE_CAPS,
+  PROP_DROP_UNMAPPED,
+  PROP_KEY_OFFSET,
+  PROP_KEY_WIDTH,
+  PROP_KEY_MASK,
+  PROP_STRIP_BYTES,
+  PROP_MAX_SIZE_BUFFERS,
+  PROP_LEAKY,
+  PROP_SEQ_OFFSET,
+  PROP_SEQ_WIDTH,
+  PROP_REORDER_WINDOW,
+  PROP_REORDER_LATENCY,
+  PROP_DROP_LATE,
+  PROP_COPIED_PACKETS,
+  PROP_STATS
 };
 
+#define GST_TYPE_UDPDEMUX_LEAKY (gst_udpdemux_leaky_get_type ())
+static GType
+gst_udpdemux_leaky_get_type (void)
+{
+  static GType udpdemux_leaky_type = 0;
+
+  static const GEnumValue udpdemux_leaky[] = {
+    {GST_UDPDEMUX_LEAKY_NONE, "Not Leaky", "no"},
+    {GST_UDPDEMUX_LEAKY_UPSTREAM, "Leaky on upstream (new buffers)",
+        "upstream"},
+    {GST_UDPDEMUX_LEAKY_DOWNSTREAM, "Leaky on downstream (old buffers)",
+        "downstream"},
+    {0, NULL, NULL},
+  };
+
+  if (!udpdemux_leaky_type) {
+    udpdemux_leaky_type =
+        g_enum_register_static ("GstUdpDemuxLeaky", udpdemux_leaky);
+  }
+  return udpdemux_leaky_type;
+}
+
 static void
 gst_udpdemux_class_init (GstUdpDemuxClass * klass)
 {
@@ -113,11 +163,7 @@ gst_udpdemux_class_init (GstUdpDemuxClass * klass)
   gst_element_class_add_pad_template (gstelement_class,
       gst_static_pad_template_get (&sink_template));
   gst_element_class_add_pad_template (gstelement_class,
-      gst_static_pad_template_get (&src_control_template));
-  gst_element_class_add_pad_template (gstelement_class,
-      gst_static_pad_template_get (&src_video_template));
-  gst_element_class_add_pad_template (gstelement_class,
-      gst_static_pad_template_get (&src_audio_template));
+      gst_static_pad_template_get (&src_template));
 
 
   gst_element_class_set_static_metadata (gstelement_class, "UDP Demux",
@@ -127,20 +173,116 @@ gst_udpdemux_class_init (GstUdpDemuxClass * klass)
 
   g_object_class_install_property (gobject_class, PROP_CAPS_CONTROL,
       g_param_spec_boxed ("caps-control", "Control Filter caps",
-          "Filter caps for control src", GST_TYPE_CAPS,
+          "Filter caps for control src (type 0)", GST_TYPE_CAPS,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
   g_object_class_install_property (gobject_class, PROP_CAPS_VIDEO,
       g_param_spec_boxed ("caps-video", "Video Filter caps",
-          "Filter caps for video src", GST_TYPE_CAPS,
+          "Filter caps for video src (type 1)", GST_TYPE_CAPS,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
   g_object_class_install_property (gobject_class, PROP_CAPS_AUDIO,
       g_param_spec_boxed ("caps-audio", "Audio Filter caps",
-          "Filter caps for audio control src", GST_TYPE_CAPS,
+          "Filter caps for audio control src (type 2)", GST_TYPE_CAPS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_TYPE_CAPS,
+      g_param_spec_boxed ("type-caps", "Type caps",
+          "Caps of the src pad of each type, as fields type-<n> holding "
+          "caps or a caps string, e.g. "
+          "\"types, type-3=(string)application/x-fec\"",
+          GST_TYPE_STRUCTURE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_DROP_UNMAPPED,
+      g_param_spec_boolean ("drop-unmapped", "Drop unmapped",
+          "Drop packets of types without caps in type-caps instead of "
+          "exposing them as " DEFAULT_TYPE_CAPS, DEFAULT_DROP_UNMAPPED,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_KEY_OFFSET,
+      g_param_spec_uint ("key-offset", "Key offset",
+          "Offset in bytes of the demux key in each packet", 0, G_MAXUINT16,
+          DEFAULT_KEY_OFFSET, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_KEY_WIDTH,
+      g_param_spec_uint ("key-width", "Key width",
+          "Size in bytes of the big-endian demux key", 1, 4,
+          DEFAULT_KEY_WIDTH, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_KEY_MASK,
+      g_param_spec_uint ("key-mask", "Key mask",
+          "Mask applied to the key, e.g. 0x7f for the RTP payload type", 0,
+          G_MAXUINT32, DEFAULT_KEY_MASK, G_PARAM_READWRITE |
+          G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_STRIP_BYTES,
+      g_param_spec_uint ("strip-bytes", "Strip bytes",
+          "Header bytes removed from the front of each packet before it is "
+          "pushed", 0, G_MAXUINT16, DEFAULT_STRIP_BYTES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_MAX_SIZE_BUFFERS,
+      g_param_spec_uint ("max-size-buffers", "Max. size (buffers)",
+          "Buffers queued on each src pad, pushed by a thread of that pad "
+          "(0 = push from the sink thread, no queues)", 0, 1 << 20,
+          DEFAULT_MAX_SIZE_BUFFERS, G_PARAM_READWRITE |
+          G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_LEAKY,
+      g_param_spec_enum ("leaky", "Leaky",
+          "Where a full src pad queue drops buffers",
+          GST_TYPE_UDPDEMUX_LEAKY, DEFAULT_LEAKY, G_PARAM_READWRITE |
+          G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_SEQ_OFFSET,
+      g_param_spec_uint ("seq-offset", "Sequence offset",
+          "Offset in bytes of the sequence number in each packet", 0,
+          G_MAXUINT16, DEFAULT_SEQ_OFFSET, G_PARAM_READWRITE |
+          G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_SEQ_WIDTH,
+      g_param_spec_uint ("seq-width", "Sequence width",
+          "Size in bytes of the big-endian sequence number", 1, 4,
+          DEFAULT_SEQ_WIDTH, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_REORDER_WINDOW,
+      g_param_spec_uint ("reorder-window", "Reorder window",
+          "Packets held per src pad to restore the sequence order, rounded "
+          "up to a power of two (0 = push in arrival order)", 0, 32768,
+          DEFAULT_REORDER_WINDOW, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_REORDER_LATENCY,
+      g_param_spec_uint ("reorder-latency", "Reorder latency",
+          "Milliseconds a packet waits for the missing ones before it", 0,
+          G_MAXUINT16, DEFAULT_REORDER_LATENCY, G_PARAM_READWRITE |
+          G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY));
+  g_object_class_install_property (gobject_class, PROP_DROP_LATE,
+      g_param_spec_boolean ("drop-late", "Drop late",
+          "Drop packets arriving after the ones following them were pushed, "
+          "instead of pushing them flagged DISCONT", DEFAULT_DROP_LATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_COPIED_PACKETS,
+      g_param_spec_uint64 ("copied-packets", "Copied packets",
+          "Packets whose payload had to be copied to strip the header",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Packets and bytes per type as type-<n> structures, drops of "
+          "unknown types, runts, unlinked pads and full queues, and the peak "
+          "packet rate per second", GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
   GST_DEBUG_CATEGORY_INIT (gst_udpdemux_debug, "udpdemux", 0, "UDP demuxer");
 }
 
+/* zeroed memory starting on a cache line, for the structures holding
+ * counters. Released with free(). */
+static gpointer
+gst_udpdemux_alloc_aligned (gsize size)
+{
+  gpointer mem;
+
+  if (posix_memalign (&mem, GST_UDPDEMUX_CACHE_LINE, size) != 0)
+    g_error ("%s: failed to allocate %" G_GSIZE_FORMAT " bytes", G_STRLOC,
+        size);
+  memset (mem, 0, size);
+
+  return mem;
+}
+
 static void
 gst_udpdemux_init (GstUdpDemux * udpdemux)
 {
@@ -152,319 +294,1816 @@ gst_udpdemux_init (GstUdpDemux * udpdemux)
   g_assert (udpdemux->sink != NULL);
 
   gst_pad_set_chain_function (udpdemux->sink, gst_udpdemux_chain);
+  gst_pad_set_chain_list_function (udpdemux->sink, gst_udpdemux_chain_list);
   gst_pad_set_event_function (udpdemux->sink, gst_udpdemux_sink_event);
 
   gst_element_add_pad (GST_ELEMENT (udpdemux), udpdemux->sink);
 
-  udpdemux->ctrlpad = gst_pad_new_from_static_template(&src_control_template, "src_0");
-  udpdemux->videopad = gst_pad_new_from_static_template(&src_video_template, "src_1");
-  udpdemux->audiopad = gst_pad_new_from_static_template(&src_audio_template, "src_2");
-
-  gst_element_add_pad (GST_ELEMENT (udpdemux), udpdemux->ctrlpad);
-  gst_element_add_pad (GST_ELEMENT (udpdemux), udpdemux->videopad);
-  gst_element_add_pad (GST_ELEMENT (udpdemux), udpdemux->audiopad);
+  udpdemux->type_caps = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) gst_caps_unref);
+  udpdemux->pads_ext = g_hash_table_new (NULL, NULL);
+  udpdemux->drop_unmapped = DEFAULT_DROP_UNMAPPED;
+  udpdemux->key_offset = DEFAULT_KEY_OFFSET;
+  udpdemux->key_width = DEFAULT_KEY_WIDTH;
+  udpdemux->key_mask = DEFAULT_KEY_MASK;
+  udpdemux->strip_bytes = DEFAULT_STRIP_BYTES;
+  udpdemux->max_size_buffers = DEFAULT_MAX_SIZE_BUFFERS;
+  udpdemux->leaky = DEFAULT_LEAKY;
+  udpdemux->seq_offset = DEFAULT_SEQ_OFFSET;
+  udpdemux->seq_width = DEFAULT_SEQ_WIDTH;
+  udpdemux->reorder_window = DEFAULT_REORDER_WINDOW;
+  udpdemux->reorder_latency = DEFAULT_REORDER_LATENCY;
+  udpdemux->drop_late = DEFAULT_DROP_LATE;
+  udpdemux->stats = gst_udpdemux_alloc_aligned (sizeof (GstUdpDemuxStats));
+  g_mutex_init (&udpdemux->timer_lock);
+  g_cond_init (&udpdemux->timer_cond);
 }
 
 static void
 gst_udpdemux_finalize (GObject * object)
 {
-  gst_udpdemux_release (GST_UDPDEMUX (object));
+  GstUdpDemux *udpdemux = GST_UDPDEMUX (object);
+
+  gst_udpdemux_release (udpdemux);
+
+  g_hash_table_destroy (udpdemux->type_caps);
+  g_hash_table_destroy (udpdemux->pads_ext);
+  free (udpdemux->stats);
+  g_mutex_clear (&udpdemux->timer_lock);
+  g_cond_clear (&udpdemux->timer_cond);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+/* copies the sticky events after the caps, the pad has a stream-start
+ * and caps of its own */
 static gboolean
-forward_sticky_events (GstPad * pad, GstEvent ** event, gpointer user_data)
+store_sticky_events (GstPad * pad, GstEvent ** event, gpointer user_data)
 {
-  GST_DEBUG ("Forwarding sticky events");
-  gboolean res = TRUE;
   GstPad *srcpad = GST_PAD_CAST (user_data);
 
-  if (!gst_pad_has_current_caps (srcpad)) {
-    GST_DEBUG ("No pads with caps available. Dropping event");
-    gst_event_unref (*event);
-    *event = NULL;
-    res = TRUE;
+  if (GST_EVENT_TYPE (*event) > GST_EVENT_CAPS)
+    gst_pad_store_sticky_event (srcpad, *event);
+
+  return TRUE;
+}
+
+/* sticky events are only given to a src pad once it is linked, they go
+ * downstream before its next buffer. The core only calls the link
+ * function of the src pad when there is one, the peer's is called here. */
+static GstPadLinkReturn
+gst_udpdemux_src_link (GstPad * pad, GstObject * parent, GstPad * peer)
+{
+  GstUdpDemux *udpdemux = GST_UDPDEMUX (parent);
+  GstUdpDemuxPad *dpad = gst_pad_get_element_private (pad);
+  GstPadLinkReturn ret;
+  GstObject *peer_parent;
+
+  if (GST_PAD_LINKFUNC (peer)) {
+    peer_parent = gst_object_get_parent (GST_OBJECT_CAST (peer));
+    ret = GST_PAD_LINKFUNC (peer) (peer, peer_parent, pad);
+    if (peer_parent)
+      gst_object_unref (peer_parent);
+    if (GST_PAD_LINK_FAILED (ret))
+      goto peer_refused;
   }
 
-  /* Stream start and caps have already been pushed */
-  if (GST_EVENT_TYPE (*event) >= GST_EVENT_SEGMENT)
-    res = gst_pad_push_event (srcpad, gst_event_ref (*event));
+  GST_DEBUG_OBJECT (pad, "linked, replaying sticky events");
+  gst_pad_sticky_events_foreach (udpdemux->sink, store_sticky_events, pad);
+  g_atomic_int_set (&dpad->linked, TRUE);
 
-  return res;
+  return GST_PAD_LINK_OK;
+
+  /* ERRORS */
+peer_refused:
+  {
+    GST_DEBUG_OBJECT (pad, "peer %s:%s refused the link: %d",
+        GST_DEBUG_PAD_NAME (peer), ret);
+    return ret;
+  }
 }
 
-static GstPad*
-find_pad_for_data_type (GstUdpDemux * udpdemux, guint8 type)
+static void
+gst_udpdemux_src_unlink (GstPad * pad, GstObject * parent)
 {
-  GstPad* rpad = NULL;
-  GSList* parse;
+  GstUdpDemuxPad *dpad = gst_pad_get_element_private (pad);
 
-  GST_OBJECT_LOCK(udpdemux);
-  for (parse = udpdemux->ls_srcpads; parse; parse = g_slist_next (parse)) {
-    GstUdpDemuxPad *pad = parse->data;
+  GST_DEBUG_OBJECT (pad, "unlinked, dropping its packets");
+  g_atomic_int_set (&dpad->linked, FALSE);
+}
 
-    if (pad->data_type == type) {
-      GST_DEBUG_OBJECT (udpdemux, "found pad for buffer type: %d", type);
-      rpad = gst_object_ref (pad->pad);
-      break;
-    }
-  }
-  GST_OBJECT_UNLOCK(udpdemux);
+static GstUdpDemuxPad *
+find_pad_for_data_type (GstUdpDemux * udpdemux, guint32 type)
+{
+  GstUdpDemuxPad *dpad;
 
-  return rpad;
+  /* the pad stays alive as long as its entry, no ref needed */
+  if (type < GST_UDPDEMUX_N_TYPES)
+    dpad = g_atomic_pointer_get (&udpdemux->pads[type]);
+  else
+    dpad = g_hash_table_lookup (udpdemux->pads_ext, GUINT_TO_POINTER (type));
+
+  return dpad;
 }
 
-static GstFlowReturn
-gst_udpdemux_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
+/* caps for the pad of the given type, NULL to drop the type */
+static GstCaps *
+gst_udpdemux_get_type_caps (GstUdpDemux * udpdemux, guint32 type)
 {
-  GstFlowReturn ret = GST_FLOW_OK;
-  GstUdpDemux *udpdemux;
-  GstMapInfo info;
-  GstPad *srcpad;
   GstCaps *caps;
-  gint8 type;
-  gsize offset;
-  gssize res;
 
-  udpdemux = GST_UDPDEMUX (parent);
+  GST_OBJECT_LOCK (udpdemux);
+  caps = g_hash_table_lookup (udpdemux->type_caps, GUINT_TO_POINTER (type));
+  if (caps)
+    caps = gst_caps_ref (caps);
+  else if (udpdemux->drop_unmapped)
+    caps = NULL;
+  else
+    caps = gst_caps_new_empty_simple (DEFAULT_TYPE_CAPS);
+  GST_OBJECT_UNLOCK (udpdemux);
 
-  // get type of data
-  gst_buffer_extract(buf, 0, &type, sizeof(gint8));
-
-  GST_DEBUG_OBJECT (udpdemux, "received buffer type %d", type);
-
-  srcpad = find_pad_for_data_type (udpdemux, type);
-  if (NULL == srcpad) {
-    GstUdpDemuxPad *udpdemuxpad;
-
-    /* add new srcpad to list */
-    if (type == TYPE_CONTROL)
-      srcpad = udpdemux->ctrlpad;
-    else if (type == TYPE_VIDEO)
-      srcpad = udpdemux->videopad;
-    else if (type == TYPE_AUDIO)
-      srcpad = udpdemux->audiopad;
-    else {
-      GST_DEBUG ("Error unsupported type: %d", type);
-      return GST_FLOW_ERROR;
-    }
+  return caps;
+}
 
-    gst_pad_use_fixed_caps (srcpad);
-    gst_pad_set_active (srcpad, TRUE);
+static GstUdpDemuxQueue *
+gst_udpdemux_queue_new (guint max_buffers, GstUdpDemuxLeaky leaky)
+{
+  GstUdpDemuxQueue *queue;
+  guint n_slots = 16;
+
+  /* room for events between the buffers */
+  while (n_slots < max_buffers * 2)
+    n_slots <<= 1;
+
+  queue = g_slice_new0 (GstUdpDemuxQueue);
+  queue->slots = g_new0 (GstUdpDemuxSlot, n_slots);
+  queue->mask = n_slots - 1;
+  queue->max_buffers = max_buffers;
+  queue->leaky = leaky;
+  queue->flushing = TRUE;
+  g_mutex_init (&queue->lock);
+  g_cond_init (&queue->cond);
+
+  return queue;
+}
 
-    gst_pad_push_event (srcpad,
-        gst_pad_get_sticky_event (udpdemux->sink, GST_EVENT_STREAM_START, 0));
+/* takes the oldest item, NULL if there is none or, with @data_only, if it
+ * is an event. Safe against the sink thread adding items. */
+static GstMiniObject *
+gst_udpdemux_queue_take (GstUdpDemuxQueue * queue, gboolean data_only,
+    guint * size)
+{
+  GstUdpDemuxSlot slot;
+  guint tail;
+
+  do {
+    tail = g_atomic_int_get (&queue->tail);
+    if (tail == (guint) g_atomic_int_get (&queue->head))
+      return NULL;
+    slot = queue->slots[tail & queue->mask];
+    if (data_only && slot.size == 0)
+      return NULL;
+  } while (!g_atomic_int_compare_and_exchange (&queue->tail, tail, tail + 1));
+
+  if (slot.size > 0)
+    g_atomic_int_add (&queue->n_buffers, -(gint) slot.size);
+  if (size)
+    *size = slot.size;
+
+  return slot.item;
+}
 
-    if (type == TYPE_CONTROL)
-      gst_pad_set_caps (srcpad, udpdemux->caps_control);
-    else if (type == TYPE_VIDEO)
-      gst_pad_set_caps (srcpad, udpdemux->caps_video);
-    else if (type == TYPE_AUDIO)
-      gst_pad_set_caps (srcpad, udpdemux->caps_audio);
+static void
+gst_udpdemux_queue_drain (GstUdpDemuxQueue * queue)
+{
+  GstMiniObject *item;
 
-    gst_pad_set_event_function(srcpad, gst_udpdemux_src_event);
+  while ((item = gst_udpdemux_queue_take (queue, FALSE, NULL)))
+    gst_mini_object_unref (item);
+}
 
-    gst_pad_sticky_events_foreach (udpdemux->sink, forward_sticky_events,
-        srcpad);
+static void
+gst_udpdemux_queue_free (GstUdpDemuxQueue * queue)
+{
+  gst_udpdemux_queue_drain (queue);
+  g_free (queue->slots);
+  g_mutex_clear (&queue->lock);
+  g_cond_clear (&queue->cond);
+  g_slice_free (GstUdpDemuxQueue, queue);
+}
 
-    GST_DEBUG ("Adding type=%d to the list.", type);
-    udpdemuxpad = g_slice_new0 (GstUdpDemuxPad);
-    udpdemuxpad->data_type = type;
-    udpdemuxpad->pad = srcpad;
+static void
+gst_udpdemux_queue_set_flushing (GstUdpDemuxQueue * queue, gboolean flushing)
+{
+  g_mutex_lock (&queue->lock);
+  g_atomic_int_set (&queue->flushing, flushing);
+  g_cond_broadcast (&queue->cond);
+  g_mutex_unlock (&queue->lock);
+}
 
-    gst_object_ref (srcpad);
-    GST_OBJECT_LOCK (udpdemux);
-    udpdemux->ls_srcpads = g_slist_append (udpdemux->ls_srcpads, udpdemuxpad);
-    GST_OBJECT_UNLOCK(udpdemux);
-  }
+static gboolean
+gst_udpdemux_queue_is_full (GstUdpDemuxQueue * queue, guint size)
+{
+  guint head, tail;
 
-  gst_buffer_map (buf, &info, GST_MAP_WRITE);
-  offset = sizeof (gint8);
-  res = info.size - offset;
+  head = g_atomic_int_get (&queue->head);
+  tail = g_atomic_int_get (&queue->tail);
+  if (head - tail > queue->mask)
+    return TRUE;
 
-  gst_buffer_unmap (buf, &info);
-  gst_buffer_resize (buf, offset, res);
+  /* events only need a slot */
+  return size > 0 &&
+      (guint) g_atomic_int_get (&queue->n_buffers) >= queue->max_buffers;
+}
 
-  /* push to srcpad */
-  ret = gst_pad_push (srcpad, buf);
+/* the task stopped on an error or EOS, nothing will be pushed anymore */
+static inline gboolean
+gst_udpdemux_queue_stopped (GstUdpDemuxQueue * queue)
+{
+  GstFlowReturn ret = g_atomic_int_get (&queue->srcresult);
 
-  gst_object_unref (srcpad);
+  return ret != GST_FLOW_OK && ret != GST_FLOW_NOT_LINKED;
+}
 
-  return ret;
+/* wakes the other side if it sleeps on @flag */
+static inline void
+gst_udpdemux_queue_wake (GstUdpDemuxQueue * queue, volatile gint * flag)
+{
+  if (g_atomic_int_get (flag)) {
+    g_mutex_lock (&queue->lock);
+    g_cond_signal (&queue->cond);
+    g_mutex_unlock (&queue->lock);
+  }
 }
 
-static gboolean
-gst_udpdemux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
+/* queues a buffer, buffer list (@size buffers) or event (@size 0) on the
+ * pad. Only called from the sink thread. */
+static GstFlowReturn
+gst_udpdemux_queue_push (GstUdpDemuxPad * dpad, GstMiniObject * item,
+    guint size)
 {
-  GstUdpDemux *udpdemux;
-  udpdemux = GST_UDPDEMUX (parent);
+  GstUdpDemuxQueue *queue = dpad->queue;
+  GstMiniObject *old;
+  GstUdpDemuxSlot *slot;
+  GstFlowReturn ret;
+  guint head, old_size;
+
+  if (gst_udpdemux_queue_stopped (queue))
+    goto stopped;
+
+  while (gst_udpdemux_queue_is_full (queue, size)) {
+    if (g_atomic_int_get (&queue->flushing))
+      goto flushing;
+    if (gst_udpdemux_queue_stopped (queue))
+      goto stopped;
+
+    if (size > 0 && queue->leaky == GST_UDPDEMUX_LEAKY_UPSTREAM) {
+      GST_LOG_OBJECT (dpad->pad, "queue full, dropping %u new buffers", size);
+      g_atomic_pointer_add (&dpad->counters.c.queue_drops, size);
+      gst_mini_object_unref (item);
+      return g_atomic_int_get (&queue->srcresult);
+    }
 
-  return gst_pad_event_default (pad, parent, event);
+    if (size > 0 && queue->leaky == GST_UDPDEMUX_LEAKY_DOWNSTREAM) {
+      old = gst_udpdemux_queue_take (queue, TRUE, &old_size);
+      if (old) {
+        GST_LOG_OBJECT (dpad->pad, "queue full, dropping %u old buffers",
+            old_size);
+        g_atomic_pointer_add (&dpad->counters.c.queue_drops, old_size);
+        gst_mini_object_unref (old);
+        continue;
+      }
+      /* an event is the oldest item, wait for the task to push it */
+    }
+
+    g_mutex_lock (&queue->lock);
+    g_atomic_int_set (&queue->blocked, TRUE);
+    while (gst_udpdemux_queue_is_full (queue, size) &&
+        !g_atomic_int_get (&queue->flushing) &&
+        !gst_udpdemux_queue_stopped (queue))
+      g_cond_wait (&queue->cond, &queue->lock);
+    g_atomic_int_set (&queue->blocked, FALSE);
+    g_mutex_unlock (&queue->lock);
+  }
+
+  if (g_atomic_int_get (&queue->flushing))
+    goto flushing;
+
+  head = queue->head;
+  slot = &queue->slots[head & queue->mask];
+  slot->item = item;
+  slot->size = size;
+  g_atomic_int_add (&queue->n_buffers, size);
+  /* publish the slot */
+  g_atomic_int_set (&queue->head, head + 1);
+
+  gst_udpdemux_queue_wake (queue, &queue->waiting);
+
+  return g_atomic_int_get (&queue->srcresult);
+
+  /* ERRORS */
+stopped:
+  {
+    ret = g_atomic_int_get (&queue->srcresult);
+    GST_LOG_OBJECT (dpad->pad, "task stopped, reason %s",
+        gst_flow_get_name (ret));
+    gst_mini_object_unref (item);
+    return ret;
+  }
+flushing:
+  {
+    GST_LOG_OBJECT (dpad->pad, "queue is flushing");
+    gst_mini_object_unref (item);
+    return GST_FLOW_FLUSHING;
+  }
 }
 
+/* takes the next item for the task, waiting for one. NULL when flushing. */
+static GstMiniObject *
+gst_udpdemux_queue_pop (GstUdpDemuxQueue * queue, guint * size)
+{
+  GstMiniObject *item;
+
+  while (!(item = gst_udpdemux_queue_take (queue, FALSE, size))) {
+    g_mutex_lock (&queue->lock);
+    g_atomic_int_set (&queue->waiting, TRUE);
+    while (g_atomic_int_get (&queue->tail) ==
+        g_atomic_int_get (&queue->head) &&
+        !g_atomic_int_get (&queue->flushing))
+      g_cond_wait (&queue->cond, &queue->lock);
+    g_atomic_int_set (&queue->waiting, FALSE);
+    g_mutex_unlock (&queue->lock);
+
+    if (g_atomic_int_get (&queue->flushing))
+      return NULL;
+  }
+
+  gst_udpdemux_queue_wake (queue, &queue->blocked);
 
-static gboolean
-gst_udpdemux_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+  return item;
+}
+
+/* task of a queued src pad */
+static void
+gst_udpdemux_loop (GstUdpDemuxPad * dpad)
 {
-  GstUdpDemux *udpdemux;
-  gboolean res = FALSE;
-  udpdemux = GST_UDPDEMUX (parent);
+  GstUdpDemuxQueue *queue = dpad->queue;
+  GstMiniObject *item;
+  GstFlowReturn ret;
+  guint size = 0;
 
-  switch (GST_EVENT_TYPE (event)) {
-    case GST_EVENT_SEGMENT:
-    {
-      GST_DEBUG ("Got SEGMENT event");
-      if (gst_pad_has_current_caps (udpdemux->ctrlpad)) {
-        GST_DEBUG ("Control Pad Caps exists. Pushing event to Control Pad");
-        gst_event_ref (event);
-        res |= gst_pad_push_event (udpdemux->ctrlpad, event);
-      }
+  if (g_atomic_int_get (&queue->flushing))
+    goto pause;
 
-      if (gst_pad_has_current_caps(udpdemux->videopad)) {
-        GST_DEBUG ("Video Pad Caps exists. Pushing event to Video Pad");
-        gst_event_ref (event);
-        res |= gst_pad_push_event (udpdemux->videopad, event);
-      }
+  item = gst_udpdemux_queue_pop (queue, &size);
+  if (item == NULL)
+    goto pause;
 
-      if (gst_pad_has_current_caps (udpdemux->audiopad)) {
-        GST_DEBUG ("Audio Pad Caps exists. Pushing event to Audio Pad");
-        gst_event_ref (event);
-        res |= gst_pad_push_event (udpdemux->audiopad, event);
-      }
-      else {
-        GST_DEBUG ("No Pads with Caps exists. Dropping event");
-        gst_event_unref (event);
-        res = TRUE;
-      }
-      break;
+  if (GST_IS_EVENT (item)) {
+    gst_pad_push_event (dpad->pad, GST_EVENT_CAST (item));
+    return;
+  }
+
+  if (GST_IS_BUFFER_LIST (item))
+    ret = gst_pad_push_list (dpad->pad, GST_BUFFER_LIST_CAST (item));
+  else
+    ret = gst_pad_push (dpad->pad, GST_BUFFER_CAST (item));
+
+  g_atomic_int_set (&queue->srcresult, ret);
+
+  /* keep draining an unlinked pad, it may get linked later */
+  if (ret == GST_FLOW_NOT_LINKED)
+    g_atomic_pointer_add (&dpad->counters.c.not_linked, size);
+  else if (ret != GST_FLOW_OK)
+    goto push_failed;
+
+  return;
+
+  /* ERRORS */
+pause:
+  {
+    GST_DEBUG_OBJECT (dpad->pad, "pausing task, flushing");
+    gst_pad_pause_task (dpad->pad);
+    return;
+  }
+push_failed:
+  {
+    GST_DEBUG_OBJECT (dpad->pad, "pausing task, reason %s",
+        gst_flow_get_name (ret));
+    /* downstream returning EOS already is at the end */
+    if (ret < GST_FLOW_EOS) {
+      GST_ELEMENT_ERROR (GST_PAD_PARENT (dpad->pad), STREAM, FAILED,
+          ("Internal data stream error."),
+          ("streaming stopped, reason %s", gst_flow_get_name (ret)));
+      gst_pad_push_event (dpad->pad, gst_event_new_eos ());
     }
-    default:
-      res = gst_pad_event_default (pad, parent, event);
-      break;
+    gst_pad_pause_task (dpad->pad);
+    /* the sink thread may wait for room that will not come */
+    g_mutex_lock (&queue->lock);
+    g_cond_broadcast (&queue->cond);
+    g_mutex_unlock (&queue->lock);
+    return;
   }
+}
 
-  return res;
+static void
+gst_udpdemux_pad_start_task (GstUdpDemuxPad * dpad)
+{
+  g_atomic_int_set (&dpad->queue->srcresult, GST_FLOW_OK);
+  gst_udpdemux_queue_set_flushing (dpad->queue, FALSE);
+  gst_pad_start_task (dpad->pad, (GstTaskFunction) gst_udpdemux_loop, dpad,
+      NULL);
+}
+
+/* unblocks the task and throws away what it had not pushed yet */
+static void
+gst_udpdemux_pad_pause_task (GstUdpDemuxPad * dpad, gboolean stop)
+{
+  gst_udpdemux_queue_set_flushing (dpad->queue, TRUE);
+  if (stop)
+    gst_pad_stop_task (dpad->pad);
+  else
+    gst_pad_pause_task (dpad->pad);
+  gst_udpdemux_queue_drain (dpad->queue);
+}
+
+/* the task has to be out of the way before the pad takes its stream lock
+ * on deactivation */
+static gboolean
+gst_udpdemux_src_activate_mode (GstPad * pad, GstObject * parent,
+    GstPadMode mode, gboolean active)
+{
+  GstUdpDemuxPad *dpad = gst_pad_get_element_private (pad);
+
+  if (dpad->queue == NULL || mode != GST_PAD_MODE_PUSH)
+    return TRUE;
+
+  if (active)
+    gst_udpdemux_pad_start_task (dpad);
+  else
+    gst_udpdemux_pad_pause_task (dpad, TRUE);
+
+  return TRUE;
 }
 
+static GstUdpDemuxReorder *
+gst_udpdemux_reorder_new (guint window)
+{
+  GstUdpDemuxReorder *reorder;
+
+  reorder = g_slice_new0 (GstUdpDemuxReorder);
+  reorder->ring = g_new0 (GstUdpDemuxHeld, window);
+  reorder->mask = window - 1;
+
+  return reorder;
+}
 
+/* forgets the held packets and the expected sequence number */
 static void
-gst_udpdemux_set_property (GObject * object, guint prop_id,
-    const GValue * value, GParamSpec * pspec)
+gst_udpdemux_reorder_reset (GstUdpDemuxReorder * reorder)
 {
-  GstUdpDemux *udpdemux = GST_UDPDEMUX (object);
+  guint i;
 
-  switch (prop_id) {
-    case PROP_CAPS_CONTROL:
-    {
-      GST_OBJECT_LOCK (udpdemux);
-      if (udpdemux->caps_control)
-        gst_caps_unref (udpdemux->caps_control);
-      udpdemux->caps_control = gst_caps_copy (gst_value_get_caps (value));
-      GST_OBJECT_UNLOCK (udpdemux);
-      break;
-    }
-    case PROP_CAPS_VIDEO:
-    {
-      GST_OBJECT_LOCK (udpdemux);
-      if (udpdemux->caps_video)
-        gst_caps_unref (udpdemux->caps_video);
-      udpdemux->caps_video = gst_caps_copy (gst_value_get_caps (value));
-      GST_OBJECT_UNLOCK (udpdemux);
-      break;
+  for (i = 0; reorder->n_held > 0 && i <= reorder->mask; i++) {
+    if (reorder->ring[i].buf) {
+      gst_buffer_unref (reorder->ring[i].buf);
+      reorder->ring[i].buf = NULL;
+      reorder->n_held--;
     }
-    case PROP_CAPS_AUDIO:
-    {
-      GST_OBJECT_LOCK (udpdemux);
-      if (udpdemux->caps_audio)
-        gst_caps_unref (udpdemux->caps_audio);
-      udpdemux->caps_audio = gst_caps_copy (gst_value_get_caps (value));
-      GST_OBJECT_UNLOCK (udpdemux);
+  }
+  reorder->have_next = FALSE;
+  reorder->discont = FALSE;
+  reorder->deadline = 0;
+}
+
+static void
+gst_udpdemux_reorder_free (GstUdpDemuxReorder * reorder)
+{
+  gst_udpdemux_reorder_reset (reorder);
+  g_free (reorder->ring);
+  g_slice_free (GstUdpDemuxReorder, reorder);
+}
+
+/* creates and publishes the src pad of a type seen for the first time.
+ * Only called from the streaming thread. */
+static GstUdpDemuxPad *
+gst_udpdemux_add_pad (GstUdpDemux * udpdemux, guint32 type, GstCaps * caps)
+{
+  GstUdpDemuxPad *udpdemuxpad;
+  GstPad *srcpad;
+  GstEvent *event, *upstream;
+  gchar *name, *stream_id;
+  guint group_id;
+
+  name = g_strdup_printf ("src_%u", type);
+  srcpad = gst_pad_new_from_static_template (&src_template, name);
+  g_free (name);
+
+  udpdemuxpad = gst_udpdemux_alloc_aligned (sizeof (GstUdpDemuxPad));
+  udpdemuxpad->data_type = type;
+  udpdemuxpad->pad = gst_object_ref (srcpad);
+  udpdemuxpad->last_flow = GST_FLOW_OK;
+  if (udpdemux->cur_max_size_buffers > 0)
+    udpdemuxpad->queue = gst_udpdemux_queue_new
+        (udpdemux->cur_max_size_buffers, udpdemux->cur_leaky);
+  if (udpdemux->cur_seq_width > 0)
+    udpdemuxpad->reorder =
+        gst_udpdemux_reorder_new (udpdemux->cur_reorder_window);
+  gst_pad_set_element_private (srcpad, udpdemuxpad);
+
+  gst_pad_use_fixed_caps (srcpad);
+  gst_pad_set_event_function (srcpad, gst_udpdemux_src_event);
+  gst_pad_set_activatemode_function (srcpad,
+      gst_udpdemux_src_activate_mode);
+  gst_pad_set_link_function (srcpad, gst_udpdemux_src_link);
+  gst_pad_set_unlink_function (srcpad, gst_udpdemux_src_unlink);
+  gst_pad_set_active (srcpad, TRUE);
+
+  /* a stream of its own within the upstream stream */
+  stream_id = gst_pad_create_stream_id_printf (srcpad,
+      GST_ELEMENT_CAST (udpdemux), "%u", type);
+  event = gst_event_new_stream_start (stream_id);
+  g_free (stream_id);
+
+  upstream = gst_pad_get_sticky_event (udpdemux->sink, GST_EVENT_STREAM_START,
+      0);
+  if (upstream) {
+    if (gst_event_parse_group_id (upstream, &group_id))
+      gst_event_set_group_id (event, group_id);
+    gst_event_unref (upstream);
+  }
+  gst_pad_push_event (srcpad, event);
+
+  gst_pad_set_caps (srcpad, caps);
+
+  gst_element_add_pad (GST_ELEMENT_CAST (udpdemux), srcpad);
+
+  GST_DEBUG_OBJECT (udpdemux, "Adding type=%d to the table, caps %"
+      GST_PTR_FORMAT, type, caps);
+
+  udpdemux->n_pads++;
+
+  /* publish only once the entry is complete */
+  if (type < GST_UDPDEMUX_N_TYPES) {
+    g_atomic_pointer_set (&udpdemux->pads[type], udpdemuxpad);
+  } else {
+    GST_OBJECT_LOCK (udpdemux);
+    g_hash_table_insert (udpdemux->pads_ext, GUINT_TO_POINTER (type),
+        udpdemuxpad);
+    GST_OBJECT_UNLOCK (udpdemux);
+  }
+
+  return udpdemuxpad;
+}
+
+/* a shared buffer is copied shallowly, its memory is only duplicated
+ * when it may not be shared. Count those, they are real payload copies. */
+static GstBuffer *
+gst_udpdemux_make_writable (GstUdpDemux * udpdemux, GstBuffer * buf)
+{
+  guint i, n;
+
+  if (gst_buffer_is_writable (buf))
+    return buf;
+
+  n = gst_buffer_n_memory (buf);
+  for (i = 0; i < n; i++) {
+    if (GST_MEMORY_FLAG_IS_SET (gst_buffer_peek_memory (buf, i),
+            GST_MEMORY_FLAG_NO_SHARE)) {
+      g_atomic_pointer_add (&udpdemux->copied_packets, 1);
       break;
     }
-    default:
-      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
-      break;
   }
+
+  return gst_buffer_make_writable (buf);
 }
 
-static void
-gst_udpdemux_get_property (GObject * object, guint prop_id, GValue * value,
-    GParamSpec * pspec)
+/* reads a big-endian field of 1 to 4 bytes */
+static gboolean
+gst_udpdemux_read_field (GstBuffer * buf, guint offset, guint width,
+    guint32 * value)
 {
-  GstUdpDemux *udpdemux = GST_UDPDEMUX (object);
+  guint8 data[4];
 
-  switch (prop_id) {
-    case PROP_CAPS_CONTROL:
-      GST_OBJECT_LOCK (udpdemux);
-      gst_value_set_caps (value, udpdemux->caps_control);
-      GST_OBJECT_UNLOCK (udpdemux);
+  if (gst_buffer_extract (buf, offset, data, width) != width)
+    return FALSE;
+
+  switch (width) {
+    case 1:
+      *value = data[0];
       break;
-    case PROP_CAPS_VIDEO:
-      GST_OBJECT_LOCK (udpdemux);
-      gst_value_set_caps (value, udpdemux->caps_video);
-      GST_OBJECT_UNLOCK (udpdemux);
+    case 2:
+      *value = GST_READ_UINT16_BE (data);
       break;
-    case PROP_CAPS_AUDIO:
-      GST_OBJECT_LOCK (udpdemux);
-      gst_value_set_caps (value, udpdemux->caps_audio);
-      GST_OBJECT_UNLOCK (udpdemux);
+    case 3:
+      *value = GST_READ_UINT24_BE (data);
       break;
     default:
-      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      *value = GST_READ_UINT32_BE (data);
       break;
   }
+
+  return TRUE;
 }
 
+/* find the src pad for @buf, read its sequence number when reordering and
+ * strip its header. Returns NULL when the packet is dropped, @buf is
+ * consumed then. */
+static GstUdpDemuxPad *
+gst_udpdemux_classify (GstUdpDemux * udpdemux, GstBuffer ** buf,
+    guint32 * seq)
+{
+  GstUdpDemuxPad *dpad;
+  GstCaps *caps;
+  guint32 type;
+  gsize offset;
+  gssize res;
+
+  // get type of data
+  if (!gst_udpdemux_read_field (*buf, udpdemux->cur_key_offset,
+          udpdemux->cur_key_width, &type))
+    goto runt;
+  type &= udpdemux->cur_key_mask;
+
+  if (udpdemux->cur_seq_width > 0 &&
+      !gst_udpdemux_read_field (*buf, udpdemux->cur_seq_offset,
+          udpdemux->cur_seq_width, seq))
+    goto runt;
+
+  /* no pad for a packet that is dropped anyway */
+  offset = udpdemux->cur_strip_bytes;
+  res = gst_buffer_get_size (*buf) - offset;
+  if (res < 0)
+    goto runt;
+
+  GST_LOG_OBJECT (udpdemux, "received buffer type %u", type);
+
+  dpad = find_pad_for_data_type (udpdemux, type);
+  if (NULL == dpad) {
+    caps = gst_udpdemux_get_type_caps (udpdemux, type);
+    if (caps == NULL) {
+      GST_LOG_OBJECT (udpdemux, "dropping packet of unmapped type %u", type);
+      g_atomic_pointer_add (&udpdemux->stats->c.unknown_type, 1);
+      gst_buffer_unref (*buf);
+      return NULL;
+    }
 
-/*
- * Free resources for the object.
- */
+    dpad = gst_udpdemux_add_pad (udpdemux, type, caps);
+    gst_caps_unref (caps);
+  }
+
+  /* strip the header by moving the start of the memory, the payload is
+   * never mapped */
+  g_atomic_pointer_add (&dpad->counters.c.packets, 1);
+  g_atomic_pointer_add (&dpad->counters.c.bytes, res + offset);
+
+  if (offset > 0) {
+    *buf = gst_udpdemux_make_writable (udpdemux, *buf);
+    gst_buffer_resize (*buf, offset, res);
+  }
+
+  return dpad;
+
+  /* ERRORS */
+runt:
+  {
+    GST_LOG_OBJECT (udpdemux, "dropping packet of %" G_GSIZE_FORMAT
+        " bytes, too short for the header", gst_buffer_get_size (*buf));
+    g_atomic_pointer_add (&udpdemux->stats->c.runts, 1);
+    gst_buffer_unref (*buf);
+    return NULL;
+  }
+}
+
+/* keeps the peak of the packet rate, measured over windows of at least
+ * a second */
 static void
-gst_udpdemux_release (GstUdpDemux * udpdemux)
+gst_udpdemux_update_rate (GstUdpDemux * udpdemux, guint n_packets)
 {
-  GSList *tmp;
-  GSList *parse;
-
-  GST_OBJECT_LOCK (udpdemux);
-  tmp = udpdemux->ls_srcpads;
-  udpdemux->ls_srcpads = NULL;
-  GST_OBJECT_UNLOCK (udpdemux);
+  gint64 now, elapsed;
+  gsize rate;
+
+  now = g_get_monotonic_time ();
+  if (udpdemux->rate_start == 0)
+    udpdemux->rate_start = now;
+
+  udpdemux->rate_packets += n_packets;
+  elapsed = now - udpdemux->rate_start;
+  if (elapsed < G_USEC_PER_SEC)
+    return;
+
+  rate = gst_util_uint64_scale (udpdemux->rate_packets, G_USEC_PER_SEC,
+      elapsed);
+  rate = MIN (rate, G_MAXINT);
+  if (rate > (gsize) g_atomic_int_get (&udpdemux->stats->c.peak_rate))
+    g_atomic_int_set (&udpdemux->stats->c.peak_rate, (gint) rate);
+
+  udpdemux->rate_start = now;
+  udpdemux->rate_packets = 0;
+}
 
-  for (parse = tmp; parse; parse = g_slist_next (parse)) {
-    GstUdpDemuxPad *pad = parse->data;
+/* pushes on the pad or hands the buffer to its task */
+static GstFlowReturn
+gst_udpdemux_pad_push (GstUdpDemuxPad * dpad, GstBuffer * buf)
+{
+  GstFlowReturn ret;
 
-    gst_pad_set_active (pad->pad, FALSE);
-    gst_element_remove_pad (GST_ELEMENT_CAST (udpdemux), pad->pad);
-    g_slice_free (GstUdpDemuxPad, pad);
+  /* the core would only say NOT_LINKED */
+  if (!g_atomic_int_get (&dpad->linked)) {
+    g_atomic_pointer_add (&dpad->counters.c.not_linked, 1);
+    gst_buffer_unref (buf);
+    return GST_FLOW_NOT_LINKED;
   }
-  g_slist_free (tmp);
+
+  if (dpad->queue)
+    return gst_udpdemux_queue_push (dpad, GST_MINI_OBJECT_CAST (buf), 1);
+
+  ret = gst_pad_push (dpad->pad, buf);
+  if (ret == GST_FLOW_NOT_LINKED)
+    g_atomic_pointer_add (&dpad->counters.c.not_linked, 1);
+
+  return ret;
 }
 
-static GstStateChangeReturn
-gst_udpdemux_change_state (GstElement * element, GstStateChange transition)
+static GstFlowReturn
+gst_udpdemux_pad_push_list (GstUdpDemuxPad * dpad, GstBufferList * list)
 {
-  GstStateChangeReturn ret;
-  GstUdpDemux *udpdemux;
+  GstFlowReturn ret;
+  guint n;
+
+  n = gst_buffer_list_length (list);
+  if (!g_atomic_int_get (&dpad->linked)) {
+    g_atomic_pointer_add (&dpad->counters.c.not_linked, n);
+    gst_buffer_list_unref (list);
+    return GST_FLOW_NOT_LINKED;
+  }
 
-  udpdemux = GST_UDPDEMUX (element);
+  if (dpad->queue)
+    return gst_udpdemux_queue_push (dpad, GST_MINI_OBJECT_CAST (list), n);
 
-  switch (transition) {
-    case GST_STATE_CHANGE_NULL_TO_READY:
-    case GST_STATE_CHANGE_READY_TO_PAUSED:
-    case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
-    default:
-      break;
+  ret = gst_pad_push_list (dpad->pad, list);
+  if (ret == GST_FLOW_NOT_LINKED)
+    g_atomic_pointer_add (&dpad->counters.c.not_linked, n);
+
+  return ret;
+}
+
+/* forwards an event to one pad. Serialized events go through the queue of
+ * a queued pad. Unlinked pads only keep the sticky ones, they are sent
+ * on once the pad is linked. */
+static gboolean
+gst_udpdemux_pad_push_event (GstUdpDemuxPad * dpad, GstEvent * event)
+{
+  if (dpad->queue && GST_EVENT_IS_SERIALIZED (event))
+    return gst_udpdemux_queue_push (dpad, GST_MINI_OBJECT_CAST (event),
+        0) != GST_FLOW_FLUSHING;
+
+  if (!gst_pad_is_linked (dpad->pad)) {
+    if (GST_EVENT_IS_STICKY (event))
+      gst_pad_store_sticky_event (dpad->pad, event);
+    gst_event_unref (event);
+    return TRUE;
   }
 
-  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+  return gst_pad_push_event (dpad->pad, event);
+}
 
-  switch (transition) {
-    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
-    case GST_STATE_CHANGE_PAUSED_TO_READY:
-      break;
-    case GST_STATE_CHANGE_READY_TO_NULL:
-      gst_udpdemux_release (udpdemux);
+/* sequence number distance a - b, signed within the field width */
+static inline gint32
+gst_udpdemux_seq_diff (GstUdpDemux * udpdemux, guint32 a, guint32 b)
+{
+  guint shift = 32 - 8 * udpdemux->cur_seq_width;
+
+  return ((gint32) ((a - b) << shift)) >> shift;
+}
+
+/* pushes a packet in sequence, or adds it to @out when not NULL */
+static GstFlowReturn
+gst_udpdemux_reorder_output (GstUdpDemux * udpdemux, GstUdpDemuxPad * dpad,
+    GstBuffer * buf, gboolean discont, GstBufferList * out)
+{
+  if (discont) {
+    buf = gst_udpdemux_make_writable (udpdemux, buf);
+    GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DISCONT);
+  }
+
+  if (out) {
+    gst_buffer_list_add (out, buf);
+    return GST_FLOW_OK;
+  }
+
+  return gst_udpdemux_pad_push (dpad, buf);
+}
+
+/* pushes the held packets from next_seq up to the first gap */
+static GstFlowReturn
+gst_udpdemux_reorder_pop (GstUdpDemux * udpdemux, GstUdpDemuxPad * dpad,
+    GstBufferList * out)
+{
+  GstUdpDemuxReorder *reorder = dpad->reorder;
+  GstFlowReturn ret = GST_FLOW_OK, res;
+  GstUdpDemuxHeld *held;
+  GstBuffer *buf;
+
+  while (reorder->n_held > 0) {
+    held = &reorder->ring[reorder->next_seq & reorder->mask];
+    if (held->buf == NULL)
+      break;
+
+    buf = held->buf;
+    held->buf = NULL;
+    reorder->n_held--;
+    reorder->next_seq = (reorder->next_seq + 1) & udpdemux->cur_seq_mask;
+
+    res = gst_udpdemux_reorder_output (udpdemux, dpad, buf,
+        reorder->discont, out);
+    reorder->discont = FALSE;
+    if (res != GST_FLOW_OK)
+      ret = res;
+  }
+
+  return ret;
+}
+
+/* gives up on the missing packets before the first held one. Only called
+ * with packets held. */
+static void
+gst_udpdemux_reorder_skip (GstUdpDemux * udpdemux, GstUdpDemuxPad * dpad)
+{
+  GstUdpDemuxReorder *reorder = dpad->reorder;
+  guint lost = 0;
+
+  while (reorder->ring[reorder->next_seq & reorder->mask].buf == NULL) {
+    reorder->next_seq = (reorder->next_seq + 1) & udpdemux->cur_seq_mask;
+    lost++;
+  }
+
+  GST_LOG_OBJECT (dpad->pad, "%u packets lost", lost);
+  g_atomic_pointer_add (&dpad->counters.c.lost, lost);
+  reorder->discont = TRUE;
+}
+
+/* stops waiting for the gaps the packets behind have waited too long for
+ * at @now, and updates the deadline of the first gap left */
+static GstFlowReturn
+gst_udpdemux_reorder_expire (GstUdpDemux * udpdemux, GstUdpDemuxPad * dpad,
+    gint64 now, GstBufferList * out)
+{
+  GstUdpDemuxReorder *reorder = dpad->reorder;
+  GstFlowReturn ret = GST_FLOW_OK, res;
+  gint64 arrival;
+  guint32 first;
+
+  reorder->deadline = 0;
+  while (reorder->n_held > 0) {
+    first = reorder->next_seq;
+    while (reorder->ring[first & reorder->mask].buf == NULL)
+      first = (first + 1) & udpdemux->cur_seq_mask;
+    arrival = reorder->ring[first & reorder->mask].arrival;
+    if (now - arrival < udpdemux->cur_reorder_latency) {
+      reorder->deadline = arrival + udpdemux->cur_reorder_latency;
+      break;
+    }
+
+    gst_udpdemux_reorder_skip (udpdemux, dpad);
+    res = gst_udpdemux_reorder_pop (udpdemux, dpad, out);
+    if (res != GST_FLOW_OK)
+      ret = res;
+  }
+
+  return ret;
+}
+
+/* wakes the timer up by @deadline at the latest */
+static void
+gst_udpdemux_timer_schedule (GstUdpDemux * udpdemux, gint64 deadline)
+{
+  g_mutex_lock (&udpdemux->timer_lock);
+  if (udpdemux->timer_deadline == 0 || deadline < udpdemux->timer_deadline) {
+    udpdemux->timer_deadline = deadline;
+    g_cond_signal (&udpdemux->timer_cond);
+  }
+  g_mutex_unlock (&udpdemux->timer_lock);
+}
+
+/* puts the packet in sequence order. Packets wait in the window for the
+ * ones missing before them until they are reorder-latency old. */
+static GstFlowReturn
+gst_udpdemux_reorder_push (GstUdpDemux * udpdemux, GstUdpDemuxPad * dpad,
+    GstBuffer * buf, guint32 seq, GstBufferList * out)
+{
+  GstUdpDemuxReorder *reorder = dpad->reorder;
+  GstFlowReturn ret = GST_FLOW_OK, res;
+  GstUdpDemuxHeld *held;
+  gint64 now, deadline;
+  gint32 diff;
+
+  if (!reorder->have_next) {
+    reorder->next_seq = seq;
+    reorder->have_next = TRUE;
+  }
+
+  diff = gst_udpdemux_seq_diff (udpdemux, seq, reorder->next_seq);
+  if (diff < 0)
+    goto late;
+
+  /* too far ahead, give up on the oldest gaps until it fits */
+  while (diff > (gint32) reorder->mask) {
+    if (reorder->n_held == 0) {
+      GST_LOG_OBJECT (dpad->pad, "jumping %d packets ahead", diff);
+      g_atomic_pointer_add (&dpad->counters.c.lost, diff);
+      reorder->next_seq = seq;
+      reorder->discont = TRUE;
+      break;
+    }
+    gst_udpdemux_reorder_skip (udpdemux, dpad);
+    res = gst_udpdemux_reorder_pop (udpdemux, dpad, out);
+    if (res != GST_FLOW_OK)
+      ret = res;
+    diff = gst_udpdemux_seq_diff (udpdemux, seq, reorder->next_seq);
+  }
+
+  now = g_get_monotonic_time ();
+
+  held = &reorder->ring[seq & reorder->mask];
+  if (held->buf)
+    goto duplicate;
+  held->buf = buf;
+  held->arrival = now;
+  reorder->n_held++;
+
+  res = gst_udpdemux_reorder_pop (udpdemux, dpad, out);
+  if (res != GST_FLOW_OK)
+    ret = res;
+
+  deadline = reorder->deadline;
+  res = gst_udpdemux_reorder_expire (udpdemux, dpad, now, out);
+  if (res != GST_FLOW_OK)
+    ret = res;
+
+  /* a new gap to wait for, in case nothing arrives after it */
+  if (reorder->deadline != 0 && reorder->deadline != deadline)
+    gst_udpdemux_timer_schedule (udpdemux, reorder->deadline);
+
+  return ret;
+
+  /* ERRORS */
+late:
+  {
+    g_atomic_pointer_add (&dpad->counters.c.late, 1);
+    if (udpdemux->cur_drop_late) {
+      GST_LOG_OBJECT (dpad->pad, "dropping packet %u, %d late", seq, -diff);
+      gst_buffer_unref (buf);
+      return GST_FLOW_OK;
+    }
+    GST_LOG_OBJECT (dpad->pad, "pushing packet %u, %d late", seq, -diff);
+    return gst_udpdemux_reorder_output (udpdemux, dpad, buf, TRUE, out);
+  }
+duplicate:
+  {
+    GST_LOG_OBJECT (dpad->pad, "dropping duplicate packet %u", seq);
+    gst_buffer_unref (buf);
+    return ret;
+  }
+}
+
+/* pushes all held packets, skipping the gaps */
+static GstFlowReturn
+gst_udpdemux_reorder_drain (GstUdpDemux * udpdemux, GstUdpDemuxPad * dpad)
+{
+  GstFlowReturn ret = GST_FLOW_OK, res;
+
+  while (dpad->reorder->n_held > 0) {
+    gst_udpdemux_reorder_skip (udpdemux, dpad);
+    res = gst_udpdemux_reorder_pop (udpdemux, dpad, NULL);
+    if (res != GST_FLOW_OK)
+      ret = res;
+  }
+  dpad->reorder->deadline = 0;
+
+  return ret;
+}
+
+/* a flow the reorder timer ran into is returned for the next buffer, the
+ * timer has no caller to hand it to */
+static GstFlowReturn
+gst_udpdemux_take_timer_flow (GstUdpDemux * udpdemux, GstFlowReturn ret)
+{
+  if (ret == GST_FLOW_OK)
+    ret = udpdemux->timer_flow;
+  udpdemux->timer_flow = GST_FLOW_OK;
+
+  return ret;
+}
+
+/* keeps the last flow return of the pad and combines it with those of
+ * the other pads, as GstFlowCombiner does. One pad not linked or at EOS
+ * is no reason to stop, all of them are. */
+static GstFlowReturn
+gst_udpdemux_combine_flows (GstUdpDemux * udpdemux, GstUdpDemuxPad * dpad,
+    GstFlowReturn ret)
+{
+  if (dpad->last_flow != ret) {
+    if (dpad->last_flow == GST_FLOW_NOT_LINKED)
+      udpdemux->n_not_linked--;
+    else if (dpad->last_flow == GST_FLOW_EOS)
+      udpdemux->n_eos--;
+
+    if (ret == GST_FLOW_NOT_LINKED)
+      udpdemux->n_not_linked++;
+    else if (ret == GST_FLOW_EOS)
+      udpdemux->n_eos++;
+
+    dpad->last_flow = ret;
+  }
+
+  if (ret == GST_FLOW_NOT_LINKED)
+    return udpdemux->n_not_linked == udpdemux->n_pads ? ret : GST_FLOW_OK;
+  if (ret == GST_FLOW_EOS)
+    return udpdemux->n_eos == udpdemux->n_pads ? ret : GST_FLOW_OK;
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_udpdemux_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
+{
+  GstFlowReturn ret;
+  GstUdpDemux *udpdemux;
+  GstUdpDemuxPad *dpad;
+  guint32 seq = 0;
+
+  udpdemux = GST_UDPDEMUX (parent);
+
+  gst_udpdemux_update_rate (udpdemux, 1);
+
+  dpad = gst_udpdemux_classify (udpdemux, &buf, &seq);
+  if (dpad == NULL)
+    return gst_udpdemux_take_timer_flow (udpdemux, GST_FLOW_OK);
+
+  if (dpad->reorder)
+    ret = gst_udpdemux_reorder_push (udpdemux, dpad, buf, seq, NULL);
+  else
+    /* push to srcpad */
+    ret = gst_udpdemux_pad_push (dpad, buf);
+
+  ret = gst_udpdemux_combine_flows (udpdemux, dpad, ret);
+
+  return gst_udpdemux_take_timer_flow (udpdemux, ret);
+}
+
+/* buffers of one batch going to the same src pad */
+typedef struct
+{
+  GstUdpDemuxPad *dpad;
+  GstBufferList *list;
+} GstUdpDemuxGroup;
+
+#define GST_UDPDEMUX_MAX_GROUPS 16
+
+/* a buffer list being classified */
+typedef struct
+{
+  GstUdpDemux *udpdemux;
+  GstUdpDemuxGroup groups[GST_UDPDEMUX_MAX_GROUPS];
+  guint n_groups;
+  guint len;
+  GstFlowReturn ret;
+} GstUdpDemuxBatch;
+
+/* takes a buffer out of the list and adds it to the group of its pad */
+static gboolean
+gst_udpdemux_classify_one (GstBuffer ** buffer, guint idx, gpointer user_data)
+{
+  GstUdpDemuxBatch *batch = (GstUdpDemuxBatch *) user_data;
+  GstUdpDemux *udpdemux = batch->udpdemux;
+  GstUdpDemuxPad *dpad;
+  GstFlowReturn res;
+  GstBuffer *buf;
+  guint32 seq = 0;
+  guint j;
+
+  /* removed from the list without an unref, the buffer is ours now */
+  buf = *buffer;
+  *buffer = NULL;
+
+  dpad = gst_udpdemux_classify (udpdemux, &buf, &seq);
+  if (dpad == NULL)
+    return TRUE;
+
+  for (j = 0; j < batch->n_groups; j++) {
+    if (batch->groups[j].dpad == dpad)
+      break;
+  }
+
+  if (j == batch->n_groups) {
+    if (batch->n_groups == GST_UDPDEMUX_MAX_GROUPS) {
+      /* unusually many types in one batch, push the rest one by one */
+      if (dpad->reorder)
+        res = gst_udpdemux_reorder_push (udpdemux, dpad, buf, seq, NULL);
+      else
+        res = gst_udpdemux_pad_push (dpad, buf);
+      res = gst_udpdemux_combine_flows (udpdemux, dpad, res);
+      if (res != GST_FLOW_OK)
+        batch->ret = res;
+      return TRUE;
+    }
+    batch->groups[j].dpad = dpad;
+    batch->groups[j].list = gst_buffer_list_new_sized (batch->len - idx);
+    batch->n_groups++;
+  }
+
+  if (dpad->reorder) {
+    res = gst_udpdemux_reorder_push (udpdemux, dpad, buf, seq,
+        batch->groups[j].list);
+    if (res != GST_FLOW_OK)
+      batch->ret = res;
+  } else {
+    gst_buffer_list_add (batch->groups[j].list, buf);
+  }
+
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_udpdemux_chain_list (GstPad * pad, GstObject * parent,
+    GstBufferList * list)
+{
+  GstUdpDemuxBatch batch;
+  GstUdpDemux *udpdemux;
+  GstUdpDemuxPad *dpad;
+  GstFlowReturn ret, res;
+  guint j;
+
+  udpdemux = GST_UDPDEMUX (parent);
+
+  /* classify the whole batch first, keeping the order per pad. The
+   * buffers are moved out of the list so that they stay writable. */
+  batch.udpdemux = udpdemux;
+  batch.n_groups = 0;
+  batch.len = gst_buffer_list_length (list);
+  batch.ret = GST_FLOW_OK;
+  gst_udpdemux_update_rate (udpdemux, batch.len);
+
+  list = gst_buffer_list_make_writable (list);
+  gst_buffer_list_foreach (list, gst_udpdemux_classify_one, &batch);
+  gst_buffer_list_unref (list);
+
+  ret = batch.ret;
+
+  /* then one push per pad */
+  for (j = 0; j < batch.n_groups; j++) {
+    dpad = batch.groups[j].dpad;
+
+    /* everything may still wait in the reorder window */
+    if (gst_buffer_list_length (batch.groups[j].list) == 0) {
+      gst_buffer_list_unref (batch.groups[j].list);
+      continue;
+    }
+
+    GST_LOG_OBJECT (udpdemux, "pushing %u buffers on %s:%s",
+        gst_buffer_list_length (batch.groups[j].list),
+        GST_DEBUG_PAD_NAME (dpad->pad));
+
+    res = gst_udpdemux_pad_push_list (dpad, batch.groups[j].list);
+    res = gst_udpdemux_combine_flows (udpdemux, dpad, res);
+    if (res != GST_FLOW_OK)
+      ret = res;
+  }
+
+  return gst_udpdemux_take_timer_flow (udpdemux, ret);
+}
+
+static gboolean
+gst_udpdemux_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  GstUdpDemux *udpdemux;
+  udpdemux = GST_UDPDEMUX (parent);
+
+  return gst_pad_event_default (pad, parent, event);
+}
+
+
+/* the entries of all pads. They are only freed when going to READY. */
+static GList *
+gst_udpdemux_get_pads (GstUdpDemux * udpdemux)
+{
+  GstUdpDemuxPad *dpad;
+  GList *pads;
+  guint i;
+
+  GST_OBJECT_LOCK (udpdemux);
+  pads = g_hash_table_get_values (udpdemux->pads_ext);
+  for (i = 0; i < GST_UDPDEMUX_N_TYPES; i++) {
+    dpad = g_atomic_pointer_get (&udpdemux->pads[i]);
+    if (dpad)
+      pads = g_list_prepend (pads, dpad);
+  }
+  GST_OBJECT_UNLOCK (udpdemux);
+
+  return pads;
+}
+
+/* pushes what waited for gaps that expired with nothing arriving after
+ * them. Runs with the stream lock of the sink pad, in place of the sink
+ * thread. */
+static void
+gst_udpdemux_timer_expire (GstUdpDemux * udpdemux)
+{
+  GstUdpDemuxPad *dpad;
+  GstFlowReturn ret;
+  GList *pads, *l;
+  gint64 now;
+
+  now = g_get_monotonic_time ();
+  pads = gst_udpdemux_get_pads (udpdemux);
+  for (l = pads; l; l = l->next) {
+    dpad = l->data;
+    if (dpad->reorder == NULL || dpad->reorder->deadline == 0)
+      continue;
+
+    ret = gst_udpdemux_reorder_expire (udpdemux, dpad, now, NULL);
+    ret = gst_udpdemux_combine_flows (udpdemux, dpad, ret);
+    if (ret != GST_FLOW_OK)
+      udpdemux->timer_flow = ret;
+    if (dpad->reorder->deadline != 0)
+      gst_udpdemux_timer_schedule (udpdemux, dpad->reorder->deadline);
+  }
+  g_list_free (pads);
+}
+
+static gpointer
+gst_udpdemux_timer_thread (GstUdpDemux * udpdemux)
+{
+  gint64 deadline;
+
+  g_mutex_lock (&udpdemux->timer_lock);
+  while (udpdemux->timer_running) {
+    deadline = udpdemux->timer_deadline;
+    if (deadline == 0) {
+      g_cond_wait (&udpdemux->timer_cond, &udpdemux->timer_lock);
+      continue;
+    }
+    if (g_get_monotonic_time () < deadline) {
+      g_cond_wait_until (&udpdemux->timer_cond, &udpdemux->timer_lock,
+          deadline);
+      continue;
+    }
+
+    /* the pads put their deadlines back while expiring */
+    udpdemux->timer_deadline = 0;
+    g_mutex_unlock (&udpdemux->timer_lock);
+
+    GST_PAD_STREAM_LOCK (udpdemux->sink);
+    gst_udpdemux_timer_expire (udpdemux);
+    GST_PAD_STREAM_UNLOCK (udpdemux->sink);
+
+    g_mutex_lock (&udpdemux->timer_lock);
+  }
+  g_mutex_unlock (&udpdemux->timer_lock);
+
+  return NULL;
+}
+
+static void
+gst_udpdemux_timer_start (GstUdpDemux * udpdemux)
+{
+  udpdemux->timer_running = TRUE;
+  udpdemux->timer_deadline = 0;
+  udpdemux->timer_thread = g_thread_new ("udpdemux-reorder",
+      (GThreadFunc) gst_udpdemux_timer_thread, udpdemux);
+}
+
+/* only called once the pads are deactivated, so the timer is not stuck
+ * in a push */
+static void
+gst_udpdemux_timer_stop (GstUdpDemux * udpdemux)
+{
+  if (udpdemux->timer_thread == NULL)
+    return;
+
+  g_mutex_lock (&udpdemux->timer_lock);
+  udpdemux->timer_running = FALSE;
+  g_cond_signal (&udpdemux->timer_cond);
+  g_mutex_unlock (&udpdemux->timer_lock);
+
+  g_thread_join (udpdemux->timer_thread);
+  udpdemux->timer_thread = NULL;
+}
+
+static gboolean
+gst_udpdemux_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  GstUdpDemux *udpdemux;
+  GstUdpDemuxPad *dpad;
+  GList *pads, *l;
+  gboolean res = TRUE;
+  udpdemux = GST_UDPDEMUX (parent);
+
+  GST_DEBUG_OBJECT (udpdemux, "got %s event", GST_EVENT_TYPE_NAME (event));
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_STREAM_START:
+    case GST_EVENT_CAPS:
+      /* every src pad has its own, made from its type. The sink pad keeps
+       * the upstream ones, new pads take the group id from there. */
+      gst_event_unref (event);
+      return TRUE;
+    default:
+      break;
+  }
+
+  pads = gst_udpdemux_get_pads (udpdemux);
+  for (l = pads; l; l = l->next) {
+    dpad = l->data;
+
+    switch (GST_EVENT_TYPE (event)) {
+      case GST_EVENT_FLUSH_START:
+        /* unblock downstream first, then the task pushing to it */
+        gst_pad_push_event (dpad->pad, gst_event_ref (event));
+        if (dpad->queue)
+          gst_udpdemux_pad_pause_task (dpad, FALSE);
+        break;
+      case GST_EVENT_FLUSH_STOP:
+        if (dpad->reorder)
+          gst_udpdemux_reorder_reset (dpad->reorder);
+        if (dpad->queue)
+          gst_udpdemux_queue_drain (dpad->queue);
+        /* linked or not, the pad has to forget its EOS and segment */
+        gst_pad_push_event (dpad->pad, gst_event_ref (event));
+        if (dpad->queue)
+          gst_udpdemux_pad_start_task (dpad);
+        dpad->last_flow = GST_FLOW_OK;
+        break;
+      case GST_EVENT_EOS:
+        /* nothing is coming for the gaps anymore */
+        if (dpad->reorder)
+          gst_udpdemux_reorder_drain (udpdemux, dpad);
+        /* fall through */
+      default:
+        res &= gst_udpdemux_pad_push_event (dpad, gst_event_ref (event));
+        break;
+    }
+  }
+  if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP) {
+    udpdemux->n_not_linked = 0;
+    udpdemux->n_eos = 0;
+    udpdemux->timer_flow = GST_FLOW_OK;
+  }
+  g_list_free (pads);
+  gst_event_unref (event);
+
+  return res;
+}
+
+
+/* sets the caps of one type, called with the object lock */
+static void
+gst_udpdemux_set_type_caps (GstUdpDemux * udpdemux, guint32 type,
+    const GstCaps * caps)
+{
+  if (caps)
+    g_hash_table_insert (udpdemux->type_caps, GUINT_TO_POINTER (type),
+        gst_caps_copy (caps));
+  else
+    g_hash_table_remove (udpdemux->type_caps, GUINT_TO_POINTER (type));
+}
+
+static gboolean
+gst_udpdemux_parse_type_caps (GQuark field_id, const GValue * value,
+    gpointer user_data)
+{
+  GstUdpDemux *udpdemux = GST_UDPDEMUX (user_data);
+  const gchar *field = g_quark_to_string (field_id);
+  GstCaps *caps = NULL;
+  gchar *end;
+  guint64 type;
+
+  if (!g_str_has_prefix (field, "type-"))
+    goto invalid;
+  type = g_ascii_strtoull (field + 5, &end, 10);
+  if (*end != '\0' || end == field + 5 || type > G_MAXUINT32)
+    goto invalid;
+
+  if (G_VALUE_HOLDS_STRING (value))
+    caps = gst_caps_from_string (g_value_get_string (value));
+  else if (GST_VALUE_HOLDS_CAPS (value))
+    caps = gst_caps_copy (gst_value_get_caps (value));
+  if (caps == NULL || !gst_caps_is_fixed (caps))
+    goto invalid;
+
+  g_hash_table_insert (udpdemux->type_caps, GUINT_TO_POINTER (type), caps);
+
+  return TRUE;
+
+invalid:
+  {
+    if (caps)
+      gst_caps_unref (caps);
+    GST_WARNING_OBJECT (udpdemux, "ignoring invalid type-caps field %s",
+        field);
+    return TRUE;
+  }
+}
+
+static GstStructure *
+gst_udpdemux_get_type_caps_structure (GstUdpDemux * udpdemux)
+{
+  GstStructure *s;
+  GHashTableIter iter;
+  gpointer key, value;
+  gchar field[16];
+
+  s = gst_structure_new_empty ("types");
+  g_hash_table_iter_init (&iter, udpdemux->type_caps);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    g_snprintf (field, sizeof (field), "type-%u", GPOINTER_TO_UINT (key));
+    gst_structure_set (s, field, GST_TYPE_CAPS, value, NULL);
+  }
+
+  return s;
+}
+
+/* adds the type-<n> field of one pad, returns its not-linked drops */
+static gsize
+gst_udpdemux_add_pad_stats (GstStructure * s, GstUdpDemuxPad * dpad)
+{
+  GstStructure *pad_stats;
+  gchar field[16];
+  gsize not_linked;
+
+  not_linked = (gsize) g_atomic_pointer_get (&dpad->counters.c.not_linked);
+  pad_stats = gst_structure_new ("pad-stats",
+      "packets", G_TYPE_UINT64,
+      (guint64) (gsize) g_atomic_pointer_get (&dpad->counters.c.packets),
+      "bytes", G_TYPE_UINT64,
+      (guint64) (gsize) g_atomic_pointer_get (&dpad->counters.c.bytes),
+      "not-linked-drops", G_TYPE_UINT64, (guint64) not_linked,
+      "queue-drops", G_TYPE_UINT64,
+      (guint64) (gsize) g_atomic_pointer_get (&dpad->counters.c.queue_drops),
+      "late-packets", G_TYPE_UINT64,
+      (guint64) (gsize) g_atomic_pointer_get (&dpad->counters.c.late),
+      "lost-packets", G_TYPE_UINT64,
+      (guint64) (gsize) g_atomic_pointer_get (&dpad->counters.c.lost),
+      NULL);
+
+  g_snprintf (field, sizeof (field), "type-%u", dpad->data_type);
+  gst_structure_set (s, field, GST_TYPE_STRUCTURE, pad_stats, NULL);
+  gst_structure_free (pad_stats);
+
+  return not_linked;
+}
+
+static GstStructure *
+gst_udpdemux_get_stats (GstUdpDemux * udpdemux)
+{
+  GstStructure *s;
+  GstUdpDemuxPad *dpad;
+  GHashTableIter iter;
+  gpointer value;
+  guint64 not_linked = 0;
+  guint i;
+
+  s = gst_structure_new ("application/x-udpdemux-stats",
+      "unknown-type-drops", G_TYPE_UINT64,
+      (guint64) (gsize) g_atomic_pointer_get (&udpdemux->stats->c.unknown_type),
+      "runt-drops", G_TYPE_UINT64,
+      (guint64) (gsize) g_atomic_pointer_get (&udpdemux->stats->c.runts),
+      "peak-packet-rate", G_TYPE_UINT64,
+      (guint64) g_atomic_int_get (&udpdemux->stats->c.peak_rate),
+      NULL);
+
+  /* the object lock keeps the pads from being freed */
+  GST_OBJECT_LOCK (udpdemux);
+  for (i = 0; i < GST_UDPDEMUX_N_TYPES; i++) {
+    dpad = g_atomic_pointer_get (&udpdemux->pads[i]);
+    if (dpad)
+      not_linked += gst_udpdemux_add_pad_stats (s, dpad);
+  }
+  g_hash_table_iter_init (&iter, udpdemux->pads_ext);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    not_linked += gst_udpdemux_add_pad_stats (s, value);
+  GST_OBJECT_UNLOCK (udpdemux);
+
+  gst_structure_set (s, "not-linked-drops", G_TYPE_UINT64, not_linked, NULL);
+
+  return s;
+}
+
+static void
+gst_udpdemux_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstUdpDemux *udpdemux = GST_UDPDEMUX (object);
+  const GstStructure *s;
+
+  switch (prop_id) {
+    case PROP_CAPS_CONTROL:
+      GST_OBJECT_LOCK (udpdemux);
+      gst_udpdemux_set_type_caps (udpdemux, TYPE_CONTROL,
+          gst_value_get_caps (value));
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_CAPS_VIDEO:
+      GST_OBJECT_LOCK (udpdemux);
+      gst_udpdemux_set_type_caps (udpdemux, TYPE_VIDEO,
+          gst_value_get_caps (value));
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_CAPS_AUDIO:
+      GST_OBJECT_LOCK (udpdemux);
+      gst_udpdemux_set_type_caps (udpdemux, TYPE_AUDIO,
+          gst_value_get_caps (value));
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_TYPE_CAPS:
+      /* replaces the whole mapping, pads already created keep their caps */
+      s = gst_value_get_structure (value);
+      GST_OBJECT_LOCK (udpdemux);
+      g_hash_table_remove_all (udpdemux->type_caps);
+      if (s)
+        gst_structure_foreach (s, gst_udpdemux_parse_type_caps, udpdemux);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_DROP_UNMAPPED:
+      GST_OBJECT_LOCK (udpdemux);
+      udpdemux->drop_unmapped = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_KEY_OFFSET:
+      GST_OBJECT_LOCK (udpdemux);
+      udpdemux->key_offset = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_KEY_WIDTH:
+      GST_OBJECT_LOCK (udpdemux);
+      udpdemux->key_width = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_KEY_MASK:
+      GST_OBJECT_LOCK (udpdemux);
+      udpdemux->key_mask = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_STRIP_BYTES:
+      GST_OBJECT_LOCK (udpdemux);
+      udpdemux->strip_bytes = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_MAX_SIZE_BUFFERS:
+      GST_OBJECT_LOCK (udpdemux);
+      udpdemux->max_size_buffers = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_LEAKY:
+      GST_OBJECT_LOCK (udpdemux);
+      udpdemux->leaky = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_SEQ_OFFSET:
+      GST_OBJECT_LOCK (udpdemux);
+      udpdemux->seq_offset = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_SEQ_WIDTH:
+      GST_OBJECT_LOCK (udpdemux);
+      udpdemux->seq_width = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_REORDER_WINDOW:
+      GST_OBJECT_LOCK (udpdemux);
+      udpdemux->reorder_window = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_REORDER_LATENCY:
+      GST_OBJECT_LOCK (udpdemux);
+      udpdemux->reorder_latency = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_DROP_LATE:
+      GST_OBJECT_LOCK (udpdemux);
+      udpdemux->drop_late = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_udpdemux_get_property (GObject * object, guint prop_id, GValue * value,
+    GParamSpec * pspec)
+{
+  GstUdpDemux *udpdemux = GST_UDPDEMUX (object);
+
+  switch (prop_id) {
+    case PROP_CAPS_CONTROL:
+      GST_OBJECT_LOCK (udpdemux);
+      gst_value_set_caps (value, g_hash_table_lookup (udpdemux->type_caps,
+              GUINT_TO_POINTER (TYPE_CONTROL)));
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_CAPS_VIDEO:
+      GST_OBJECT_LOCK (udpdemux);
+      gst_value_set_caps (value, g_hash_table_lookup (udpdemux->type_caps,
+              GUINT_TO_POINTER (TYPE_VIDEO)));
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_CAPS_AUDIO:
+      GST_OBJECT_LOCK (udpdemux);
+      gst_value_set_caps (value, g_hash_table_lookup (udpdemux->type_caps,
+              GUINT_TO_POINTER (TYPE_AUDIO)));
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_TYPE_CAPS:
+      GST_OBJECT_LOCK (udpdemux);
+      g_value_take_boxed (value,
+          gst_udpdemux_get_type_caps_structure (udpdemux));
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_DROP_UNMAPPED:
+      GST_OBJECT_LOCK (udpdemux);
+      g_value_set_boolean (value, udpdemux->drop_unmapped);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_KEY_OFFSET:
+      GST_OBJECT_LOCK (udpdemux);
+      g_value_set_uint (value, udpdemux->key_offset);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_KEY_WIDTH:
+      GST_OBJECT_LOCK (udpdemux);
+      g_value_set_uint (value, udpdemux->key_width);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_KEY_MASK:
+      GST_OBJECT_LOCK (udpdemux);
+      g_value_set_uint (value, udpdemux->key_mask);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_STRIP_BYTES:
+      GST_OBJECT_LOCK (udpdemux);
+      g_value_set_uint (value, udpdemux->strip_bytes);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_MAX_SIZE_BUFFERS:
+      GST_OBJECT_LOCK (udpdemux);
+      g_value_set_uint (value, udpdemux->max_size_buffers);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_LEAKY:
+      GST_OBJECT_LOCK (udpdemux);
+      g_value_set_enum (value, udpdemux->leaky);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_SEQ_OFFSET:
+      GST_OBJECT_LOCK (udpdemux);
+      g_value_set_uint (value, udpdemux->seq_offset);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_SEQ_WIDTH:
+      GST_OBJECT_LOCK (udpdemux);
+      g_value_set_uint (value, udpdemux->seq_width);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_REORDER_WINDOW:
+      GST_OBJECT_LOCK (udpdemux);
+      g_value_set_uint (value, udpdemux->reorder_window);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_REORDER_LATENCY:
+      GST_OBJECT_LOCK (udpdemux);
+      g_value_set_uint (value, udpdemux->reorder_latency);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_DROP_LATE:
+      GST_OBJECT_LOCK (udpdemux);
+      g_value_set_boolean (value, udpdemux->drop_late);
+      GST_OBJECT_UNLOCK (udpdemux);
+      break;
+    case PROP_COPIED_PACKETS:
+      g_value_set_uint64 (value,
+          (gsize) g_atomic_pointer_get (&udpdemux->copied_packets));
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value, gst_udpdemux_get_stats (udpdemux));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+
+/*
+ * Free resources for the object.
+ */
+static void
+gst_udpdemux_free_pad (GstUdpDemux * udpdemux, GstUdpDemuxPad * pad)
+{
+  /* stops the task of a queued pad */
+  gst_pad_set_active (pad->pad, FALSE);
+  gst_element_remove_pad (GST_ELEMENT_CAST (udpdemux), pad->pad);
+  gst_object_unref (pad->pad);
+  if (pad->queue)
+    gst_udpdemux_queue_free (pad->queue);
+  if (pad->reorder)
+    gst_udpdemux_reorder_free (pad->reorder);
+  free (pad);
+}
+
+static void
+gst_udpdemux_release (GstUdpDemux * udpdemux)
+{
+  GstUdpDemuxPad *pad;
+  GList *ext, *l;
+  guint i;
+
+  /* streaming has stopped, only the stats property still reads the
+   * tables, with the object lock */
+  GST_OBJECT_LOCK (udpdemux);
+  ext = g_hash_table_get_values (udpdemux->pads_ext);
+  g_hash_table_remove_all (udpdemux->pads_ext);
+  for (i = 0; i < GST_UDPDEMUX_N_TYPES; i++) {
+    pad = g_atomic_pointer_get (&udpdemux->pads[i]);
+    if (pad == NULL)
+      continue;
+    g_atomic_pointer_set (&udpdemux->pads[i], NULL);
+    ext = g_list_prepend (ext, pad);
+  }
+  GST_OBJECT_UNLOCK (udpdemux);
+
+  for (l = ext; l; l = l->next)
+    gst_udpdemux_free_pad (udpdemux, l->data);
+  g_list_free (ext);
+
+  udpdemux->n_pads = 0;
+  udpdemux->n_not_linked = 0;
+  udpdemux->n_eos = 0;
+  udpdemux->timer_flow = GST_FLOW_OK;
+}
+
+static GstStateChangeReturn
+gst_udpdemux_change_state (GstElement * element, GstStateChange transition)
+{
+  GstStateChangeReturn ret;
+  GstUdpDemux *udpdemux;
+  guint window;
+
+  udpdemux = GST_UDPDEMUX (element);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      GST_OBJECT_LOCK (udpdemux);
+      udpdemux->cur_key_offset = udpdemux->key_offset;
+      udpdemux->cur_key_width = udpdemux->key_width;
+      udpdemux->cur_key_mask = udpdemux->key_mask;
+      udpdemux->cur_strip_bytes = udpdemux->strip_bytes;
+      udpdemux->cur_max_size_buffers = udpdemux->max_size_buffers;
+      udpdemux->cur_leaky = udpdemux->leaky;
+      udpdemux->cur_seq_offset = udpdemux->seq_offset;
+      udpdemux->cur_seq_width =
+          udpdemux->reorder_window > 0 ? udpdemux->seq_width : 0;
+      udpdemux->cur_seq_mask = udpdemux->seq_width == 4 ? G_MAXUINT32 :
+          (1U << (8 * udpdemux->seq_width)) - 1;
+      /* a power of two, at most half the sequence space */
+      window = 1;
+      while (window < udpdemux->reorder_window)
+        window <<= 1;
+      udpdemux->cur_reorder_window =
+          MIN (window, (udpdemux->cur_seq_mask >> 1) + 1);
+      udpdemux->cur_reorder_latency =
+          (gint64) udpdemux->reorder_latency * 1000;
+      udpdemux->cur_drop_late = udpdemux->drop_late;
+      GST_OBJECT_UNLOCK (udpdemux);
+      memset (udpdemux->stats, 0, sizeof (GstUdpDemuxStats));
+      udpdemux->rate_start = 0;
+      udpdemux->rate_packets = 0;
+      if (udpdemux->cur_seq_width > 0)
+        gst_udpdemux_timer_start (udpdemux);
+      break;
+    case GST_STATE_CHANGE_NULL_TO_READY:
+    case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      if (ret == GST_STATE_CHANGE_FAILURE)
+        gst_udpdemux_timer_stop (udpdemux);
+      break;
+    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_udpdemux_timer_stop (udpdemux);
+      /* the pads come back with the first packets of the next run */
+      gst_udpdemux_release (udpdemux);
+      break;
+    case GST_STATE_CHANGE_READY_TO_NULL:
       break;
     default:
       break;
@@ -34,6 +34,7 @@
 #define GST_IS_UDPDEMUX(obj)         (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_UDPDEMUX))
 #define GST_IS_UDPDEMUX_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_UDPDEMUX))
 
+/* types of the legacy caps-control, caps-video and caps-audio properties */
 enum {
   TYPE_CONTROL = 0,
   TYPE_VIDEO,
@@ -43,14 +44,124 @@ enum {
 typedef struct _GstUdpDemux GstUdpDemux;
 typedef struct _GstUdpDemuxClass GstUdpDemuxClass;
 typedef struct _GstUdpDemuxPad GstUdpDemuxPad;
+typedef struct _GstUdpDemuxQueue GstUdpDemuxQueue;
+
+/* what a full pad queue does with more data, as the queue element */
+typedef enum {
+  GST_UDPDEMUX_LEAKY_NONE,        /* block the sink thread */
+  GST_UDPDEMUX_LEAKY_UPSTREAM,    /* drop the new buffers */
+  GST_UDPDEMUX_LEAKY_DOWNSTREAM   /* drop the oldest queued buffers */
+} GstUdpDemuxLeaky;
+
+/* keys below this are looked up in a flat table */
+#define GST_UDPDEMUX_N_TYPES 256
+
+/* counters are kept on cache lines of their own, the structures holding
+ * them are allocated on a line boundary */
+#define GST_UDPDEMUX_CACHE_LINE 64
+
+/*
+ * Traffic counters of one src pad. Only the streaming thread writes them,
+ * with atomics so the stats property can read them at any time.
+ */
+typedef union
+{
+  struct
+  {
+    volatile gsize packets;
+    volatile gsize bytes;
+    volatile gsize not_linked;    /* packets dropped, pad not linked */
+    volatile gsize queue_drops;   /* packets dropped by a leaky queue */
+    volatile gsize late;          /* packets behind the reorder window */
+    volatile gsize lost;          /* sequence numbers given up on */
+  } c;
+  guint8 padding[GST_UDPDEMUX_CACHE_LINE];
+} GstUdpDemuxCounters;
+
+/*
+ * Element wide counters, written by the streaming thread with atomics.
+ */
+typedef union
+{
+  struct
+  {
+    volatile gsize unknown_type;  /* packets dropped, type unmapped */
+    volatile gsize runts;         /* packets dropped, shorter than the key */
+    volatile gint peak_rate;      /* packets per second */
+  } c;
+  guint8 padding[GST_UDPDEMUX_CACHE_LINE];
+} GstUdpDemuxStats;
+
+/* one queued buffer, buffer list or event */
+typedef struct
+{
+  GstMiniObject *item;
+  guint size;                 /* buffers, 0 for an event */
+} GstUdpDemuxSlot;
+
+/*
+ * Bounded ring between the sink thread, the only one adding items, and
+ * the task of a src pad taking them. The tail is advanced with a compare
+ * and exchange so a downstream leaky sink thread can drop the oldest item
+ * too. The lock and cond are only used to sleep on an empty or full ring.
+ */
+struct _GstUdpDemuxQueue
+{
+  GstUdpDemuxSlot *slots;
+  guint mask;                 /* number of slots - 1 */
+  guint max_buffers;
+  GstUdpDemuxLeaky leaky;
+
+  volatile gint head;         /* next slot to fill, sink thread */
+  /* a line apart, wherever the ring starts */
+  guint8 padding[GST_UDPDEMUX_CACHE_LINE];
+  volatile gint tail;         /* next slot to take */
+  volatile gint n_buffers;    /* buffers in the ring */
+
+  volatile gint flushing;
+  volatile gint srcresult;    /* last flow return of the task */
+
+  GMutex lock;
+  GCond cond;
+  volatile gint waiting;      /* the task sleeps on an empty ring */
+  volatile gint blocked;      /* the sink thread sleeps on a full ring */
+};
+
+/* a packet held for reordering */
+typedef struct
+{
+  GstBuffer *buf;
+  gint64 arrival;             /* monotonic time in microseconds */
+} GstUdpDemuxHeld;
+
+/*
+ * Reorder window of a src pad, a ring indexed by sequence number modulo
+ * its size. Used with the stream lock of the sink pad held, by the sink
+ * thread and by the reorder timer.
+ */
+typedef struct
+{
+  GstUdpDemuxHeld *ring;
+  guint mask;                 /* window - 1 */
+  guint32 next_seq;           /* first sequence number not pushed yet */
+  gboolean have_next;
+  guint n_held;
+  gboolean discont;           /* the next packet pushed follows a gap */
+  gint64 deadline;            /* when the first gap expires, 0 for none */
+} GstUdpDemuxReorder;
 
 /*
  * Item for storing GstPad<->data_type pairs.
  */
 struct _GstUdpDemuxPad
 {
+  GstUdpDemuxCounters counters;
   GstPad *pad;
-  gint8 data_type;
+  guint32 data_type;
+  GstUdpDemuxQueue *queue;    /* NULL when pushing from the sink thread */
+  GstUdpDemuxReorder *reorder;  /* NULL when not reordering */
+  volatile gint linked;       /* set by the link and unlink functions */
+  GstFlowReturn last_flow;    /* sink thread only */
 };
 
 struct _GstUdpDemux
@@ -58,15 +169,67 @@ struct _GstUdpDemux
   GstElement parent;  /**< parent class */
 
   GstPad *sink;           /* sink pad */
-  GstPad* ctrlpad;        /* rtcp src pad */
-  GstPad* videopad;       /* video src pad */
-  GstPad* audiopad;       /* audio src pad */
 
-  GstCaps* caps_control;
-  GstCaps* caps_video;
-  GstCaps* caps_audio;
+  /* properties, protected by the object lock */
+  GHashTable *type_caps;      /* key -> GstCaps */
+  gboolean drop_unmapped;
+  guint key_offset;
+  guint key_width;
+  guint32 key_mask;
+  guint strip_bytes;
+  guint max_size_buffers;
+  GstUdpDemuxLeaky leaky;
+  guint seq_offset;
+  guint seq_width;
+  guint reorder_window;
+  guint reorder_latency;      /* milliseconds */
+  gboolean drop_late;
+
+  /* copy of the key properties for the streaming thread, taken when going
+   * to PAUSED */
+  guint cur_key_offset;
+  guint cur_key_width;
+  guint32 cur_key_mask;
+  guint cur_strip_bytes;
+  guint cur_max_size_buffers;
+  GstUdpDemuxLeaky cur_leaky;
+  guint cur_seq_offset;
+  guint cur_seq_width;        /* 0 when not reordering */
+  guint32 cur_seq_mask;
+  guint cur_reorder_window;   /* rounded up to a power of two */
+  gint64 cur_reorder_latency; /* microseconds */
+  gboolean cur_drop_late;
+
+  /* pad of each type, NULL until the first packet of that type. Entries
+   * are only written by the streaming thread and published with atomics,
+   * the chain function reads them without locking. They are freed once
+   * streaming has stopped, after being cleared with the object lock held
+   * so the stats property can walk the table under that lock. */
+  GstUdpDemuxPad *pads[GST_UDPDEMUX_N_TYPES];
+  /* pads of keys from GST_UDPDEMUX_N_TYPES up. Written by the streaming
+   * thread with the object lock, which reads it without. */
+  GHashTable *pads_ext;
+
+  /* flow combining over the pads, sink thread only */
+  guint n_pads;
+  guint n_not_linked;
+  guint n_eos;
+  GstFlowReturn timer_flow;   /* of the last expiry, for the next buffer */
+
+  volatile gsize copied_packets;  /* atomic */
+
+  GstUdpDemuxStats *stats;     /* on a cache line of its own */
 
-  GSList *ls_srcpads;   /* linked list of GstUdpDemuxPad objects */
+  /* packet rate measurement, streaming thread only */
+  gint64 rate_start;
+  guint rate_packets;
+  /* expires the gaps of pads nothing arrives on anymore, protected by
+   * timer_lock */
+  GThread *timer_thread;
+  GMutex timer_lock;
+  GCond timer_cond;
+  gboolean timer_running;
+  gint64 timer_deadline;      /* earliest gap deadline, 0 for none */
 };
 
 struct _GstUdpDemuxClass